@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)  // 默认块大小
+#define ARENA_ALIGN 8                 // 分配对齐字节数
+
+// 初始化内存池
+void arena_init(Arena* arena) {
+    arena->head = NULL;
+}
+
+// 从内存池分配size字节(已清零)；当前块不足时申请新块，超大请求单独成块
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock* block = arena->head;
+    if (block == NULL || block->used + size > block->size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL) {
+            perror("内存分配失败");
+            exit(EXIT_FAILURE);
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+    void* ptr = block->data + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+// 扩大一块由arena分配的数组：分配new_size字节并复制旧内容(旧内存随内存池一起释放)
+void* arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size) {
+    void* ptr = arena_alloc(arena, new_size);
+    if (old != NULL && old_size > 0) {
+        memcpy(ptr, old, old_size);
+    }
+    return ptr;
+}
+
+// 保证数组还能再放入一个元素：count已达容量时按倍增扩容，返回(可能更新后的)数组
+void* arena_reserve(Arena* arena, void* array, int* capacity, int count, size_t elem_size) {
+    if (count < *capacity) {
+        return array;
+    }
+    int new_capacity = *capacity > 0 ? *capacity * 2 : 8;
+    array = arena_grow(arena, array, (size_t)count * elem_size, (size_t)new_capacity * elem_size);
+    *capacity = new_capacity;
+    return array;
+}
+
+// 在内存池中复制字符串
+char* arena_strdup(Arena* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+// 在内存池中复制字符串的前len个字符
+char* arena_strndup(Arena* arena, const char* str, size_t len) {
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// 一次性释放内存池中的全部内存
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
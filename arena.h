@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// 内存池中的一块连续内存
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;  // 上一块(链表)
+    size_t size;              // 数据区大小
+    size_t used;              // 已使用字节数
+    char data[];              // 数据区
+} ArenaBlock;
+
+// 内存池(arena)：只分配不单独释放，最后通过arena_free一次性释放全部内存
+typedef struct {
+    ArenaBlock* head;         // 当前正在使用的块
+} Arena;
+
+void arena_init(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size);
+void* arena_reserve(Arena* arena, void* array, int* capacity, int count, size_t elem_size);
+char* arena_strdup(Arena* arena, const char* str);
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+void arena_free(Arena* arena);
+
+#endif
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "level2.h"
+#include "level3.h"
+
+// 端到端基准测试：在临时目录中生成合成Makefile(宽扇出、长链、菱形DAG、变量密集命令)
+// 及对应的文件(全部目标都已是最新)，重复测量解析、建图、依赖检查、拓扑排序和
+// 无操作构建检查的耗时，结果以CSV输出：shape,rules,edges,run,phase,seconds
+
+#define BENCH_WORK_DIR "bench_work"       // 生成的Makefile和文件所在目录
+#define BENCH_DIAMOND_WIDTH 64            // 菱形DAG每层的节点数
+#define BENCH_DEFAULT_RUNS 3              // 每种配置的重复次数
+#define BENCH_SERIAL_CHECK_LIMIT 0        // 串行检查(check_timestamps_and_build)的规则数上限，0为不限
+
+typedef enum {
+    SHAPE_FANOUT,     // all依赖全部目标，每个目标依赖同一个源文件
+    SHAPE_CHAIN,      // t(i)依赖t(i-1)的长链
+    SHAPE_DIAMOND,    // 分层DAG，每个节点依赖下一层相邻的两个节点
+    SHAPE_VARIABLES,  // 扇出结构，命令行引用多层嵌套的各种变量
+    SHAPE_COUNT
+} Shape;
+
+static const char* shape_names[SHAPE_COUNT] = { "fanout", "chain", "diamond", "variables" };
+static const int default_sizes[] = { 100, 1000, 10000, 100000 };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 创建(或截断)一个空文件并设置修改时间
+static int touch_file(const char* path, time_t mtime) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+    int ok = futimens(fd, times) == 0;
+    close(fd);
+    return ok;
+}
+
+// 写出菱形DAG中节点i的依赖：下一层的同列和右侧相邻节点(都不存在时依赖源文件)
+static void write_diamond_deps(FILE* out, int i, int n) {
+    int width = BENCH_DIAMOND_WIDTH;
+    int layer = i / width;
+    int below = (layer + 1) * width + i % width;
+    int right = (layer + 1) * width + (i % width + 1) % width;
+    int any = 0;
+    if (below < n) {
+        fprintf(out, " t%d", below);
+        any = 1;
+    }
+    if (right < n && right != below) {
+        fprintf(out, " t%d", right);
+        any = 1;
+    }
+    if (!any) {
+        fputs(" src.c", out);
+    }
+}
+
+// 生成指定形状、rules个规则的Makefile，并创建全部文件：
+// 源文件的修改时间早于所有目标，目标之间时间相同，因此整个构建是无操作的
+static int generate_makefile(Shape shape, int rules) {
+    FILE* out = fopen("Makefile", "w");
+    if (out == NULL) {
+        perror("错误: 无法创建Makefile");
+        return 0;
+    }
+    int targets = rules;  // t0..t(targets-1)
+    if (shape == SHAPE_FANOUT || shape == SHAPE_VARIABLES) {
+        targets = rules - 1;  // 另有一个all规则
+    }
+
+    if (shape == SHAPE_VARIABLES) {
+        fputs("CC = gcc\n"
+              "WARN := -Wall -Wextra\n"
+              "OPT ?= -O2\n"
+              "CFLAGS = $(WARN) $(OPT) -g\n"
+              "CFLAGS += -DBENCH=1\n"
+              "INCLUDES = -Iinclude -Ilib -I$(SRC_DIR)\n"
+              "SRC_DIR := src\n"
+              "DEFS := -DVERSION=1 -DNAME=bench\n"
+              "COMPILE = $(CC) $(CFLAGS) $(INCLUDES) $(DEFS)\n"
+              "OUT = t\n\n", out);
+    }
+    if (shape == SHAPE_FANOUT || shape == SHAPE_VARIABLES) {
+        fputs("all:", out);
+        for (int i = 0; i < targets; i++) {
+            fprintf(out, " t%d", i);
+        }
+        fputs("\n\ttouch all\n\n", out);
+    }
+
+    for (int i = targets - 1; i >= 0; i--) {
+        fprintf(out, "t%d:", i);
+        switch (shape) {
+        case SHAPE_CHAIN:
+            if (i > 0) {
+                fprintf(out, " t%d", i - 1);
+            } else {
+                fputs(" src.c", out);
+            }
+            fprintf(out, "\n\tcp src.c t%d\n\n", i);
+            break;
+        case SHAPE_DIAMOND:
+            write_diamond_deps(out, i, targets);
+            fprintf(out, "\n\ttouch t%d\n\n", i);
+            break;
+        case SHAPE_VARIABLES:
+            fprintf(out, " src.c\n\t$(COMPILE) -c src.c -o $(OUT)%d\n"
+                         "\techo $(CC) $(CFLAGS) done $(OUT)%d\n\n", i, i);
+            break;
+        default:
+            fprintf(out, " src.c\n\tcp src.c t%d\n\n", i);
+            break;
+        }
+    }
+    if (fclose(out) != 0) {
+        perror("错误: 写入Makefile失败");
+        return 0;
+    }
+
+    time_t base = time(NULL) - 60;
+    if (!touch_file("src.c", base) || ((shape == SHAPE_FANOUT || shape == SHAPE_VARIABLES)
+                                       && !touch_file("all", base + 1))) {
+        perror("错误: 无法创建文件");
+        return 0;
+    }
+    char name[32];
+    for (int i = 0; i < targets; i++) {
+        snprintf(name, sizeof(name), "t%d", i);
+        if (!touch_file(name, base + 1)) {
+            perror("错误: 无法创建文件");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 删除生成的文件
+static void remove_generated(int rules) {
+    char name[32];
+    for (int i = 0; i < rules; i++) {
+        snprintf(name, sizeof(name), "t%d", i);
+        unlink(name);
+    }
+    unlink("all");
+    unlink("src.c");
+    unlink("Makefile");
+}
+
+// 清空stat缓存，使每次检查都从冷缓存开始
+static void reset_stat_cache(DependencyGraph* graph) {
+    for (int i = 0; i < graph->node_count; i++) {
+        invalidate_stat(graph, i);
+    }
+}
+
+static void write_row(FILE* csv, Shape shape, int rules, int edges, int run,
+                      const char* phase, double seconds) {
+    fprintf(csv, "%s,%d,%d,%d,%s,%.6f\n", shape_names[shape], rules, edges, run, phase, seconds);
+}
+
+// 对一种配置执行一轮测量。构建过程的输出重定向到/dev/null，CSV行写入csv。
+// 返回0表示成功
+static int bench_run(FILE* csv, Shape shape, int rules, int run, int serial_limit) {
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    double times[6];
+    int edges = 0;
+    int failed = 0;
+    MakefileData data;
+    init_makefile_data(&data);
+
+    double start = now_seconds();
+    int result = parse_and_check_makefile("Makefile", &data, NULL);
+    times[0] = now_seconds() - start;
+
+    DependencyGraph* graph = NULL;
+    int* topo_order = NULL;
+    int order_size = 0;
+    if (result == 0) {
+        start = now_seconds();
+        graph = build_dependency_graph(&data);
+        times[1] = now_seconds() - start;
+        edges = graph->edge_count;
+
+        start = now_seconds();
+        check_dependencies(&data, graph);
+        times[2] = now_seconds() - start;
+
+        start = now_seconds();
+        topo_order = topological_sort(graph, &order_size);
+        times[3] = now_seconds() - start;
+
+        // 可用-l限制串行检查的规模，超出上限时跳过
+        times[4] = -1;
+        if (serial_limit <= 0 || rules <= serial_limit) {
+            reset_stat_cache(graph);
+            start = now_seconds();
+            failed = check_timestamps_and_build(&data, graph, topo_order, order_size);
+            times[4] = now_seconds() - start;
+        }
+
+        reset_stat_cache(graph);
+        start = now_seconds();
+        failed |= parallel_build(&data, graph, topo_order, order_size, 1);
+        times[5] = now_seconds() - start;
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    if (result != 0) {
+        fprintf(stderr, "错误: %s/%d 的Makefile解析失败 (返回值: %d)\n",
+                shape_names[shape], rules, result);
+        for (int i = 0; i < data.error_count; i++) {
+            fprintf(stderr, "  %s\n", data.errors[i]);
+        }
+        free_makefile_data(&data);
+        return 1;
+    }
+    if (failed || data.error_count > 0 || order_size != graph->node_count) {
+        fprintf(stderr, "警告: %s/%d 的无操作构建检查不干净(错误%d个)\n",
+                shape_names[shape], rules, data.error_count);
+    }
+
+    write_row(csv, shape, rules, edges, run, "parse", times[0]);
+    write_row(csv, shape, rules, edges, run, "build_graph", times[1]);
+    write_row(csv, shape, rules, edges, run, "check_dependencies", times[2]);
+    write_row(csv, shape, rules, edges, run, "topological_sort", times[3]);
+    if (times[4] >= 0) {
+        write_row(csv, shape, rules, edges, run, "noop_serial", times[4]);
+    }
+    write_row(csv, shape, rules, edges, run, "noop_parallel", times[5]);
+    fflush(csv);
+
+    free(topo_order);
+    free_graph(graph);
+    free_makefile_data(&data);
+    return 0;
+}
+
+static void show_usage(const char* program_name) {
+    printf("用法: %s [-o FILE] [-r RUNS] [-s SHAPE] [-l LIMIT] [规则数]...\n", program_name);
+    printf("  -o FILE   CSV结果写入FILE(默认标准输出)\n");
+    printf("  -r RUNS   每种配置重复测量RUNS次(默认%d)\n", BENCH_DEFAULT_RUNS);
+    printf("  -s SHAPE  只测量一种形状: fanout、chain、diamond或variables\n");
+    printf("  -l LIMIT  规则数不超过LIMIT时才测量串行检查(默认不限)\n");
+    printf("  规则数    默认为100 1000 10000 100000，最大可到1000000\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+    int runs = BENCH_DEFAULT_RUNS;
+    int serial_limit = BENCH_SERIAL_CHECK_LIMIT;
+    int only_shape = -1;
+    int* sizes = (int*)malloc((argc + 4) * sizeof(int));
+    int size_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            show_usage(argv[0]);
+            free(sizes);
+            return 0;
+        } else if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-r") == 0
+                    || strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-l") == 0) && i + 1 < argc) {
+            char option = argv[i][1];
+            const char* value = argv[++i];
+            if (option == 'o') {
+                output = value;
+            } else if (option == 'r') {
+                runs = atoi(value);
+            } else if (option == 'l') {
+                serial_limit = atoi(value);
+            } else {
+                for (int s = 0; s < SHAPE_COUNT; s++) {
+                    if (strcmp(value, shape_names[s]) == 0) {
+                        only_shape = s;
+                    }
+                }
+                if (only_shape == -1) {
+                    fprintf(stderr, "错误: 未知的形状 '%s'\n", value);
+                    free(sizes);
+                    return 1;
+                }
+            }
+        } else if (atoi(argv[i]) >= 2) {
+            sizes[size_count++] = atoi(argv[i]);
+        } else {
+            fprintf(stderr, "错误: 不正确的参数 '%s'\n", argv[i]);
+            show_usage(argv[0]);
+            free(sizes);
+            return 1;
+        }
+    }
+    if (size_count == 0) {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+            sizes[size_count++] = default_sizes[i];
+        }
+    }
+    if (runs <= 0) {
+        runs = 1;
+    }
+
+    // CSV在切换工作目录之前打开，相对路径相对于调用者的当前目录
+    FILE* csv = output != NULL ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (csv == NULL) {
+        perror("错误: 无法打开结果文件");
+        free(sizes);
+        return 1;
+    }
+    if (mkdir(BENCH_WORK_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("错误: 无法创建工作目录" BENCH_WORK_DIR);
+        fclose(csv);
+        free(sizes);
+        return 1;
+    }
+    if (chdir(BENCH_WORK_DIR) != 0) {
+        perror("错误: 无法进入工作目录" BENCH_WORK_DIR);
+        fclose(csv);
+        free(sizes);
+        return 1;
+    }
+
+    fprintf(csv, "shape,rules,edges,run,phase,seconds\n");
+    int status = 0;
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+        if (only_shape != -1 && s != only_shape) {
+            continue;
+        }
+        for (int k = 0; k < size_count; k++) {
+            int rules = sizes[k];
+            fprintf(stderr, "生成 %s: %d 个规则\n", shape_names[s], rules);
+            if (!generate_makefile((Shape)s, rules)) {
+                status = 1;
+                remove_generated(rules);
+                continue;
+            }
+            for (int run = 1; run <= runs; run++) {
+                if (bench_run(csv, (Shape)s, rules, run, serial_limit) != 0) {
+                    status = 1;
+                    break;
+                }
+            }
+            remove_generated(rules);
+        }
+    }
+
+    if (chdir("..") == 0) {
+        rmdir(BENCH_WORK_DIR);
+    }
+    fclose(csv);
+    free(sizes);
+    return status;
+}
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "build_db.h"
+#include "level3.h"
+
+#define HASH_READ_CHUNK (64 * 1024)  // 计算哈希时每次读取的字节数
+#define BUILD_DB_HEADER "# minimake build database v2"
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// 快速计算文件内容的64位哈希：按8字节分组混合，尾部逐字节处理，最后做一次雪崩
+uint64_t hash_file_content(const char* path, int* ok) {
+    *ok = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    unsigned char* buffer = (unsigned char*)malloc(HASH_READ_CHUNK);
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    uint64_t total = 0;
+    ssize_t n;
+    while ((n = read(fd, buffer, HASH_READ_CHUNK)) > 0) {
+        ssize_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, buffer + i, 8);
+            h ^= w * 0x87C37B91114253D5ull;
+            h = rotl64(h, 31) * 0x4CF5AD432745937Full;
+        }
+        for (; i < n; i++) {
+            h ^= buffer[i];
+            h *= 0x100000001B3ull;
+        }
+        total += n;
+    }
+    free(buffer);
+    close(fd);
+    if (n < 0) {
+        return 0;
+    }
+    h ^= total;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    *ok = 1;
+    return h;
+}
+
+// 计算规则展开后命令列表的签名(命令之间以换行分隔，避免拼接歧义)
+uint64_t hash_commands(char** commands, int count) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (int i = 0; i < count; i++) {
+        for (const char* p = commands[i]; *p; p++) {
+            h ^= (unsigned char)*p;
+            h *= 0x100000001B3ull;
+        }
+        h ^= '\n';
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// 释放一个目标记录中的依赖哈希
+static void clear_record(TargetRecord* record) {
+    free(record->deps);
+    record->deps = NULL;
+    record->dep_count = 0;
+    record->recorded = 0;
+}
+
+// 保留一行不在当前依赖图中的记录。模式规则只为本次构建目标的依赖闭包实例化，
+// 其他目标的记录在之后构建它们时还要用到
+static void carry_line(BuildDb* db, const char* line) {
+    size_t len = strlen(line);
+    if (db->carried_len + len + 2 > db->carried_capacity) {
+        size_t capacity = db->carried_capacity > 0 ? db->carried_capacity : 1024;
+        while (db->carried_len + len + 2 > capacity) {
+            capacity *= 2;
+        }
+        db->carried = (char*)realloc(db->carried, capacity);
+        db->carried_capacity = capacity;
+    }
+    memcpy(db->carried + db->carried_len, line, len);
+    db->carried_len += len;
+    db->carried[db->carried_len++] = '\n';
+    db->carried[db->carried_len] = '\0';
+}
+
+// 目标在图中但它的某个依赖不在图中时，把已读入的记录连同其余D行一起原样保留
+static void carry_record(BuildDb* db, DependencyGraph* graph, int node, TargetRecord* record, int count) {
+    char line[64];
+    snprintf(line, sizeof(line), "T %016" PRIx64 " %016" PRIx64 " %d ", record->output_hash,
+             record->command_hash, count);
+    char* text = (char*)malloc(strlen(line) + strlen(node_name(graph, node)) + 1);
+    strcpy(text, line);
+    strcat(text, node_name(graph, node));
+    carry_line(db, text);
+    for (int j = 0; j < record->dep_count; j++) {
+        const char* dep = node_name(graph, record->deps[j].node);
+        text = (char*)realloc(text, strlen(dep) + 24);
+        snprintf(text, strlen(dep) + 24, "D %016" PRIx64 " %s", record->deps[j].hash, dep);
+        carry_line(db, text);
+    }
+    free(text);
+    clear_record(record);
+}
+
+// 加载构建数据库；文件不存在时返回空数据库。不在当前依赖图里的路径的记录原样保留，保存时写回
+BuildDb* build_db_load(DependencyGraph* graph, const char* path) {
+    BuildDb* db = (BuildDb*)calloc(1, sizeof(BuildDb));
+    int n = graph->node_count > 0 ? graph->node_count : 1;
+    db->node_count = graph->node_count;
+    db->files = (FileHashEntry*)calloc(n, sizeof(FileHashEntry));
+    db->targets = (TargetRecord*)calloc(n, sizeof(TargetRecord));
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return db;
+    }
+
+    char* line = NULL;
+    size_t cap = 0;
+    TargetRecord* current = NULL;  // 正在读取其D行的目标记录
+    int current_node = -1;
+    int current_count = 0;
+    int carrying = 0;              // 正在原样保留的T行之后的D行
+    int remaining = 0;
+    while (getline(&line, &cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        uint64_t hash, command_hash;
+        long long sec, nsec, size;
+        int count, offset = 0;
+
+        if (sscanf(line, "F %" SCNx64 " %lld %lld %lld %n", &hash, &sec, &nsec, &size, &offset) == 4
+            && offset > 0) {
+            int node = find_node_index(graph, line + offset);
+            if (node != -1) {
+                FileHashEntry* entry = &db->files[node];
+                entry->has_hash = 1;
+                entry->hash = hash;
+                entry->mtime.tv_sec = sec;
+                entry->mtime.tv_nsec = nsec;
+                entry->size = size;
+            } else {
+                carry_line(db, line);
+            }
+            current = NULL;
+            carrying = 0;
+        } else if (sscanf(line, "T %" SCNx64 " %" SCNx64 " %d %n", &hash, &command_hash, &count, &offset) == 3
+                   && offset > 0) {
+            int node = find_node_index(graph, line + offset);
+            current = NULL;
+            remaining = count;
+            carrying = node == -1 && count >= 0;
+            if (carrying) {
+                carry_line(db, line);
+            }
+            if (node != -1 && count >= 0) {
+                current = &db->targets[node];
+                current_node = node;
+                current_count = count;
+                clear_record(current);
+                current->recorded = 1;
+                current->output_hash = hash;
+                current->command_hash = command_hash;
+                current->deps = (DepHash*)calloc(count > 0 ? count : 1, sizeof(DepHash));
+            }
+        } else if (sscanf(line, "D %" SCNx64 " %n", &hash, &offset) == 1 && offset > 0) {
+            if (carrying && remaining > 0) {
+                carry_line(db, line);
+            } else if (current != NULL && remaining > 0) {
+                int node = find_node_index(graph, line + offset);
+                if (node == -1) {
+                    // 依赖不在本次的图中(例如只为其他构建目标实例化的模式规则的依赖)，
+                    // 记录在本次构建中作废，但原样写回
+                    carry_record(db, graph, current_node, current, current_count);
+                    carry_line(db, line);
+                    current = NULL;
+                    carrying = 1;
+                } else {
+                    current->deps[current->dep_count].node = node;
+                    current->deps[current->dep_count].hash = hash;
+                    current->dep_count++;
+                }
+            }
+            remaining--;
+        }
+    }
+    free(line);
+    fclose(file);
+    return db;
+}
+
+// 写回构建数据库(先写临时文件再重命名)，成功返回0
+int build_db_save(BuildDb* db, DependencyGraph* graph, const char* path) {
+    if (!db->modified) {
+        return 0;
+    }
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        perror("警告：无法写入构建数据库");
+        return 1;
+    }
+    fprintf(file, "%s\n", BUILD_DB_HEADER);
+    // 保留的记录写在前面：同一路径后读到的记录覆盖先读到的
+    if (db->carried_len > 0) {
+        fwrite(db->carried, 1, db->carried_len, file);
+    }
+    for (int i = 0; i < db->node_count; i++) {
+        FileHashEntry* entry = &db->files[i];
+        if (entry->has_hash) {
+            fprintf(file, "F %016" PRIx64 " %lld %lld %lld %s\n", entry->hash,
+                    (long long)entry->mtime.tv_sec, (long long)entry->mtime.tv_nsec,
+                    entry->size, node_name(graph, i));
+        }
+    }
+    for (int i = 0; i < db->node_count; i++) {
+        TargetRecord* record = &db->targets[i];
+        if (!record->recorded) {
+            continue;
+        }
+        fprintf(file, "T %016" PRIx64 " %016" PRIx64 " %d %s\n", record->output_hash,
+                record->command_hash, record->dep_count, node_name(graph, i));
+        for (int j = 0; j < record->dep_count; j++) {
+            fprintf(file, "D %016" PRIx64 " %s\n", record->deps[j].hash,
+                    node_name(graph, record->deps[j].node));
+        }
+    }
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        perror("警告：无法写入构建数据库");
+        return 1;
+    }
+    db->modified = 0;
+    return 0;
+}
+
+// 依赖图增加了节点(重新读取depfile后)：扩展按节点索引的数组，新节点没有记录
+void build_db_resize(BuildDb* db, int node_count) {
+    int n = node_count > 0 ? node_count : 1;
+    db->files = (FileHashEntry*)realloc(db->files, n * sizeof(FileHashEntry));
+    db->targets = (TargetRecord*)realloc(db->targets, n * sizeof(TargetRecord));
+    memset(db->files + db->node_count, 0, (node_count - db->node_count) * sizeof(FileHashEntry));
+    memset(db->targets + db->node_count, 0, (node_count - db->node_count) * sizeof(TargetRecord));
+    db->node_count = node_count;
+}
+
+// 释放构建数据库
+void build_db_free(BuildDb* db) {
+    if (db == NULL) {
+        return;
+    }
+    for (int i = 0; i < db->node_count; i++) {
+        free(db->targets[i].deps);
+    }
+    free(db->targets);
+    free(db->files);
+    free(db->carried);
+    free(db);
+}
+
+// 惰性获取节点文件的内容哈希：mtime和大小与缓存一致时不再读取文件。文件不存在返回0
+int build_db_file_hash(BuildDb* db, DependencyGraph* graph, int node, uint64_t* hash) {
+    const StatEntry* st = stat_node(graph, node);
+    if (!st->exists) {
+        return 0;
+    }
+    FileHashEntry* entry = &db->files[node];
+    if (!entry->has_hash || entry->size != st->size
+        || entry->mtime.tv_sec != st->mtime.tv_sec || entry->mtime.tv_nsec != st->mtime.tv_nsec) {
+        int ok;
+        uint64_t h = hash_file_content(node_name(graph, node), &ok);
+        if (!ok) {
+            return 0;
+        }
+        entry->has_hash = 1;
+        entry->hash = h;
+        entry->mtime = st->mtime;
+        entry->size = st->size;
+        db->modified = 1;
+        db->hash_count++;
+    }
+    *hash = entry->hash;
+    return 1;
+}
+
+// 判断依赖内容是否与目标上次成功构建时相同(仅在mtime表明可能变化时调用)。
+// 没有记录或无法计算哈希时返回0，即按mtime判断为已变化
+int build_db_dep_unchanged(BuildDb* db, DependencyGraph* graph, int target, int dep) {
+    TargetRecord* record = &db->targets[target];
+    if (!record->recorded) {
+        return 0;
+    }
+    for (int i = 0; i < record->dep_count; i++) {
+        if (record->deps[i].node == dep) {
+            uint64_t current;
+            return build_db_file_hash(db, graph, dep, &current) && current == record->deps[i].hash;
+        }
+    }
+    return 0;
+}
+
+// 判断目标的命令签名是否与上次成功构建时不同(没有记录时不视为变化，交给mtime判断)
+int build_db_commands_changed(BuildDb* db, int target, uint64_t command_hash) {
+    TargetRecord* record = &db->targets[target];
+    return record->recorded && record->command_hash != command_hash;
+}
+
+// 目标的规则成功执行后，记录目标文件、其所有依赖的内容哈希以及命令签名
+void build_db_record(BuildDb* db, DependencyGraph* graph, int target, uint64_t command_hash) {
+    TargetRecord* record = &db->targets[target];
+    clear_record(record);
+    db->modified = 1;
+
+    int begin = graph->in_offset[target];
+    int count = graph->in_offset[target + 1] - begin;
+    record->deps = (DepHash*)calloc(count > 0 ? count : 1, sizeof(DepHash));
+    for (int e = 0; e < count; e++) {
+        int dep = graph->in_edges[begin + e];
+        uint64_t hash;
+        if (!build_db_file_hash(db, graph, dep, &hash)) {
+            clear_record(record);  // 依赖文件不存在(如伪目标)，不记录
+            return;
+        }
+        record->deps[record->dep_count].node = dep;
+        record->deps[record->dep_count].hash = hash;
+        record->dep_count++;
+    }
+    if (!build_db_file_hash(db, graph, target, &record->output_hash)) {
+        record->output_hash = 0;  // 规则没有生成同名文件
+    }
+    record->command_hash = command_hash;
+    record->recorded = 1;
+}
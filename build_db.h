@@ -0,0 +1,57 @@
+#ifndef BUILD_DB_H
+#define BUILD_DB_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define BUILD_DB_FILE ".minimake.db"  // 构建数据库文件名(位于当前目录)
+
+struct DependencyGraph;
+
+// 文件内容哈希缓存项：只要mtime和大小未变，就沿用上次计算的哈希
+typedef struct {
+    int has_hash;              // hash字段是否有效
+    uint64_t hash;             // 文件内容哈希
+    struct timespec mtime;     // 计算哈希时文件的mtime
+    long long size;            // 计算哈希时文件的大小
+} FileHashEntry;
+
+// 依赖及其在目标上次成功构建时的内容哈希
+typedef struct {
+    int node;
+    uint64_t hash;
+} DepHash;
+
+// 目标上次成功构建的记录
+typedef struct {
+    int recorded;              // 是否有记录
+    uint64_t output_hash;      // 构建后目标文件的哈希
+    uint64_t command_hash;     // 构建时展开后命令列表的签名
+    DepHash* deps;             // 各依赖当时的哈希
+    int dep_count;
+} TargetRecord;
+
+// 持久化的构建数据库，按依赖图节点下标索引
+typedef struct {
+    int node_count;
+    FileHashEntry* files;      // 文件哈希缓存
+    TargetRecord* targets;     // 目标构建记录
+    int modified;              // 是否有需要写回的变化
+    int hash_count;            // 本轮实际计算哈希的文件数
+    char* carried;             // 不在当前依赖图中的路径的记录行(原样写回，不丢弃)
+    size_t carried_len;
+    size_t carried_capacity;
+} BuildDb;
+
+uint64_t hash_file_content(const char* path, int* ok);
+uint64_t hash_commands(char** commands, int count);
+BuildDb* build_db_load(struct DependencyGraph* graph, const char* path);
+int build_db_save(BuildDb* db, struct DependencyGraph* graph, const char* path);
+void build_db_free(BuildDb* db);
+void build_db_resize(BuildDb* db, int node_count);
+int build_db_file_hash(BuildDb* db, struct DependencyGraph* graph, int node, uint64_t* hash);
+int build_db_dep_unchanged(BuildDb* db, struct DependencyGraph* graph, int target, int dep);
+int build_db_commands_changed(BuildDb* db, int target, uint64_t command_hash);
+void build_db_record(BuildDb* db, struct DependencyGraph* graph, int target, uint64_t command_hash);
+
+#endif
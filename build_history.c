@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "build_history.h"
+#include "level3.h"
+
+#define BUILD_HISTORY_HEADER "# minimake build history v1"
+#define BUILD_HISTORY_DEFAULT 1.0  // 还没有任何记录时每个目标的估计耗时(秒)
+
+// 保留一行不在当前依赖图中的目标的记录(只为本次构建目标实例化的模式规则之外的目标)
+static void carry_line(BuildHistory* history, const char* line) {
+    size_t len = strlen(line);
+    if (history->carried_len + len + 2 > history->carried_capacity) {
+        size_t capacity = history->carried_capacity > 0 ? history->carried_capacity : 1024;
+        while (history->carried_len + len + 2 > capacity) {
+            capacity *= 2;
+        }
+        history->carried = (char*)realloc(history->carried, capacity);
+        history->carried_capacity = capacity;
+    }
+    memcpy(history->carried + history->carried_len, line, len);
+    history->carried_len += len;
+    history->carried[history->carried_len++] = '\n';
+    history->carried[history->carried_len] = '\0';
+}
+
+// 加载耗时历史；文件不存在时返回空历史。不在当前依赖图里的目标的记录原样保留，保存时写回
+BuildHistory* build_history_load(DependencyGraph* graph, const char* path) {
+    BuildHistory* history = (BuildHistory*)calloc(1, sizeof(BuildHistory));
+    int n = graph->node_count > 0 ? graph->node_count : 1;
+    history->node_count = graph->node_count;
+    history->seconds = (double*)malloc(n * sizeof(double));
+    for (int i = 0; i < n; i++) {
+        history->seconds[i] = -1;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return history;
+    }
+    char* line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        double seconds;
+        int offset = 0;
+        if (sscanf(line, "%lf %n", &seconds, &offset) == 1 && offset > 0 && seconds >= 0) {
+            int node = find_node_index(graph, line + offset);
+            if (node != -1) {
+                if (history->seconds[node] < 0) {
+                    history->recorded_count++;
+                }
+                history->seconds[node] = seconds;
+            } else {
+                carry_line(history, line);
+            }
+        }
+    }
+    free(line);
+    fclose(file);
+    return history;
+}
+
+// 写回耗时历史(先写临时文件再重命名)，成功返回0
+int build_history_save(BuildHistory* history, DependencyGraph* graph, const char* path) {
+    if (!history->modified) {
+        return 0;
+    }
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        perror("警告：无法写入构建耗时历史");
+        return 1;
+    }
+    fprintf(file, "%s\n", BUILD_HISTORY_HEADER);
+    // 保留的记录写在前面：同一目标后读到的记录覆盖先读到的
+    if (history->carried_len > 0) {
+        fwrite(history->carried, 1, history->carried_len, file);
+    }
+    for (int i = 0; i < history->node_count; i++) {
+        if (history->seconds[i] >= 0) {
+            fprintf(file, "%.6f %s\n", history->seconds[i], node_name(graph, i));
+        }
+    }
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        perror("警告：无法写入构建耗时历史");
+        return 1;
+    }
+    history->modified = 0;
+    return 0;
+}
+
+// 依赖图增加了节点(重新读取depfile后)：新节点没有耗时记录
+void build_history_resize(BuildHistory* history, int node_count) {
+    history->seconds = (double*)realloc(history->seconds, (node_count > 0 ? node_count : 1) * sizeof(double));
+    for (int i = history->node_count; i < node_count; i++) {
+        history->seconds[i] = -1;
+    }
+    history->node_count = node_count;
+}
+
+void build_history_free(BuildHistory* history) {
+    if (history == NULL) {
+        return;
+    }
+    free(history->seconds);
+    free(history->carried);
+    free(history);
+}
+
+// 记录目标本次成功构建的耗时(覆盖旧值)
+void build_history_record(BuildHistory* history, int node, double seconds) {
+    if (history->seconds[node] < 0) {
+        history->recorded_count++;
+    }
+    history->seconds[node] = seconds;
+    history->modified = 1;
+}
+
+// 没有记录的目标的估计耗时：所有记录的平均值(都没有时为默认值)
+double build_history_mean(const BuildHistory* history) {
+    if (history->recorded_count == 0) {
+        return BUILD_HISTORY_DEFAULT;
+    }
+    double total = 0;
+    for (int i = 0; i < history->node_count; i++) {
+        if (history->seconds[i] >= 0) {
+            total += history->seconds[i];
+        }
+    }
+    return total / history->recorded_count;
+}
@@ -0,0 +1,26 @@
+#ifndef BUILD_HISTORY_H
+#define BUILD_HISTORY_H
+
+#define BUILD_HISTORY_FILE ".minimake.history"  // 目标构建耗时历史文件名(位于当前目录)
+
+struct DependencyGraph;
+
+// 各目标最近一次成功构建的耗时，按依赖图节点下标索引
+typedef struct {
+    int node_count;
+    double* seconds;           // 墙钟耗时(秒)，小于0表示没有记录
+    int recorded_count;        // 有记录的目标数
+    int modified;              // 是否有需要写回的变化
+    char* carried;             // 不在当前依赖图中的目标的记录行(原样写回，不丢弃)
+    size_t carried_len;
+    size_t carried_capacity;
+} BuildHistory;
+
+BuildHistory* build_history_load(struct DependencyGraph* graph, const char* path);
+int build_history_save(BuildHistory* history, struct DependencyGraph* graph, const char* path);
+void build_history_free(BuildHistory* history);
+void build_history_resize(BuildHistory* history, int node_count);
+void build_history_record(BuildHistory* history, int node, double seconds);
+double build_history_mean(const BuildHistory* history);
+
+#endif
@@ -0,0 +1,384 @@
+#define _GNU_SOURCE  // accept4、MSG_CMSG_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "watch.h"
+#include "level3.h"
+#include "pattern_rules.h"
+#include "jobserver.h"
+
+// 常驻构建守护进程(--daemon)：持有解析后的MakefileData、依赖图和stat缓存，
+// 在项目目录的Unix套接字上接受请求。客户端(--client)把目标列表和自己的标准输出、
+// 标准错误描述符(SCM_RIGHTS)一起发来，构建期间守护进程和子进程直接写客户端的终端，
+// 结束后回送退出状态。项目中所有节点所在的目录都用inotify监视，文件变化只使对应的
+// stat缓存失效；Makefile变化时重新解析。
+//
+// 请求(一个SOCK_SEQPACKET消息)："jobs N\n"，随后每个目标一行"goal NAME\n"
+// 应答："status N\n"
+
+// 客户端提前关闭输出时写操作返回EPIPE而不是终止守护进程。
+// 用空处理函数而不是SIG_IGN：忽略状态会被exec继承，影响构建命令
+static void handle_pipe(int sig) {
+    (void)sig;
+}
+
+// SIGINT/SIGTERM与监视模式相同只设置退出标志，主循环退出后删除套接字
+static void install_signals(void) {
+    watch_install_stop_signals();
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = handle_pipe;
+    sigaction(SIGPIPE, &sa, NULL);
+}
+
+static void socket_address(struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", DAEMON_SOCKET);
+}
+
+// 连接守护进程，没有运行中的守护进程时返回-1
+static int connect_daemon(void) {
+    struct sockaddr_un addr;
+    socket_address(&addr);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 创建监听套接字。套接字文件已存在但无人监听(上次异常退出)时删除后重建
+static int listen_socket(void) {
+    struct sockaddr_un addr;
+    socket_address(&addr);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("错误: 无法创建套接字");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno == EADDRINUSE) {
+        int other = connect_daemon();
+        if (other >= 0) {
+            close(other);
+            close(fd);
+            printf("错误: 守护进程已在运行 (%s)\n", DAEMON_SOCKET);
+            return -1;
+        }
+        unlink(DAEMON_SOCKET);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("错误: 无法绑定套接字" DAEMON_SOCKET);
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 16) != 0) {
+        perror("错误: 无法监听套接字" DAEMON_SOCKET);
+        close(fd);
+        unlink(DAEMON_SOCKET);
+        return -1;
+    }
+    return fd;
+}
+
+// 守护进程持有的构建状态：依赖图和拓扑序在Makefile变化前一直复用
+typedef struct {
+    MakefileData* data;
+    const char* makefile_path;
+    DependencyGraph* graph;      // Makefile解析失败时为NULL
+    int* topo_order;
+    int order_size;
+    Watcher watcher;
+} DaemonState;
+
+// 建依赖图并监视所有节点所在的目录
+static void load_state(DaemonState* state) {
+    watcher_open(&state->watcher);
+    watch_file(&state->watcher, state->makefile_path);
+    state->graph = prepare_build(state->data, NULL, 0, &state->topo_order, &state->order_size);
+    if (state->graph != NULL) {
+        for (int i = 0; i < state->graph->node_count; i++) {
+            watch_file(&state->watcher, node_name(state->graph, i));
+        }
+    }
+}
+
+static void release_state(DaemonState* state) {
+    watcher_close(&state->watcher);
+    if (state->graph != NULL) {
+        release_build(state->graph, state->topo_order);
+        state->graph = NULL;
+    }
+}
+
+// 读出所有已到达的inotify事件(不阻塞)：变化的节点stat缓存失效，Makefile变化返回1
+static int drain_events(DaemonState* state) {
+    char* buffer = (char*)malloc(WATCH_BUFFER_SIZE);
+    int makefile_changed = 0;
+    struct pollfd pfd = { state->watcher.fd, POLLIN, 0 };
+    while (poll(&pfd, 1, 0) > 0) {
+        ssize_t length = read(state->watcher.fd, buffer, WATCH_BUFFER_SIZE);
+        if (length <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            char path[4096];
+            if (event->mask & IN_Q_OVERFLOW) {
+                makefile_changed = 1;  // 丢失了事件，全部重新加载
+            } else if (event->len > 0 && watcher_event_path(&state->watcher, event, path, sizeof(path))) {
+                if (strcmp(path, watch_normalize_path(state->makefile_path)) == 0) {
+                    makefile_changed = 1;
+                } else if (state->graph != NULL) {
+                    int node = find_node_index(state->graph, path);
+                    if (node != -1) {
+                        invalidate_stat(state->graph, node);
+                    }
+                }
+            }
+        }
+    }
+    free(buffer);
+    return makefile_changed;
+}
+
+// 在客户端的输出上执行一次构建，返回退出状态
+static int build_for_client(DaemonState* state, int jobs, const char** goals, int goal_count) {
+    if (state->graph == NULL) {
+        printf("Makefile解析失败，无法构建\n");
+        return 1;
+    }
+    MakefileData* data = state->data;
+    data->error_count = 0;
+
+    // 请求的目标需要实例化新的模式规则时，依赖图要连同新规则一起重建。
+    // 目标名本身可能刚被驻留(图中还没有这个节点)，这不需要重建：select_goals直接用常驻的图
+    // 报告"没有规则可以构建目标"，拼错的目标名不会使守护进程反复重建
+    int instantiated = resolve_implicit_rules(data, goals, goal_count, NULL, NULL);
+    if (instantiated > 0) {
+        printf("实例化了新的模式规则，重新建立依赖图\n");
+        release_state(state);
+        load_state(state);
+        if (state->graph == NULL) {
+            return 1;
+        }
+    }
+    DependencyGraph* graph = state->graph;
+    free(graph->needed);
+    graph->needed = NULL;
+    if (select_goals(data, graph, goals, goal_count) == 0) {
+        check_dependencies(data, graph);
+    }
+    if (data->error_count > 0) {
+        for (int i = 0; i < data->error_count; i++) {
+            printf("Error: %s\n", data->errors[i]);
+        }
+        return 1;
+    }
+    // 与本地构建一样按请求的-j建立jobserver，递归调用的$(MAKE)共享同一并发预算
+    jobserver_setup(jobs);
+    int status = run_build(data, graph, state->topo_order, state->order_size, jobs);
+    jobserver_shutdown();
+
+    // 重新编译的源文件可能包含了新的头文件：按变化的depfile更新依赖边，并监视新节点所在的目录
+    int old_count = graph->node_count;
+    if (refresh_depfile_edges(data, graph, &state->topo_order, &state->order_size)) {
+        for (int i = old_count; i < graph->node_count; i++) {
+            watch_file(&state->watcher, node_name(graph, i));
+        }
+    }
+    return status;
+}
+
+// 处理一个客户端连接：读取请求和描述符，把标准输出/错误临时换成客户端的，构建后回送状态
+static void serve_client(DaemonState* state, int conn) {
+    char* message = (char*)malloc(DAEMON_MESSAGE_MAX + 1);
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = { message, DAEMON_MESSAGE_MAX };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t length = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (length <= 0 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        printf("警告: 忽略无效的客户端请求\n");
+        free(message);
+        return;
+    }
+    int client_fds[2];
+    memcpy(client_fds, CMSG_DATA(cmsg), sizeof(client_fds));
+    message[length] = '\0';
+
+    // 解析请求：目标名直接指向消息缓冲区
+    int jobs = 0;
+    const char** goals = (const char**)malloc((length / 2 + 1) * sizeof(char*));
+    int goal_count = 0;
+    for (char* line = strtok(message, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        if (strncmp(line, "jobs ", 5) == 0) {
+            jobs = atoi(line + 5);
+        } else if (strncmp(line, "goal ", 5) == 0) {
+            goals[goal_count++] = line + 5;
+        }
+    }
+
+    printf("客户端请求: %d 个目标 (-j %d)\n", goal_count, jobs);
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(client_fds[0], STDOUT_FILENO);
+    dup2(client_fds[1], STDERR_FILENO);
+    close(client_fds[0]);
+    close(client_fds[1]);
+
+    int status = build_for_client(state, jobs, goals, goal_count);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    char reply[32];
+    int reply_len = snprintf(reply, sizeof(reply), "status %d\n", status);
+    send(conn, reply, reply_len, MSG_NOSIGNAL);
+    printf("请求完成，退出状态 %d\n", status);
+    free(goals);
+    free(message);
+}
+
+// 守护进程主循环，收到SIGINT/SIGTERM后删除套接字并返回
+int daemon_serve(MakefileData* data, const char* makefile_path) {
+    int listen_fd = listen_socket();
+    if (listen_fd < 0) {
+        return 1;
+    }
+    install_signals();
+
+    DaemonState state;
+    memset(&state, 0, sizeof(state));
+    state.data = data;
+    state.makefile_path = makefile_path;
+    load_state(&state);
+    printf("\n===== 守护进程已启动，监听 %s (Ctrl-C退出) =====\n", DAEMON_SOCKET);
+    fflush(stdout);
+
+    while (!watch_stop_requested) {
+        struct pollfd pfds[2] = { { listen_fd, POLLIN, 0 }, { state.watcher.fd, POLLIN, 0 } };
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("错误: poll失败");
+            break;
+        }
+
+        // 先处理文件变化，保证之后的请求看到的是最新状态
+        if (drain_events(&state)) {
+            printf("\nMakefile已改变，重新解析\n");
+            release_state(&state);
+            if (reload_makefile(data, makefile_path)) {
+                load_state(&state);
+            } else {
+                watcher_open(&state.watcher);
+                watch_file(&state.watcher, makefile_path);
+            }
+            fflush(stdout);
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (conn >= 0) {
+                serve_client(&state, conn);
+                close(conn);
+                fflush(stdout);
+            }
+        }
+    }
+
+    printf("\n守护进程退出\n");
+    release_state(&state);
+    close(listen_fd);
+    unlink(DAEMON_SOCKET);
+    return 0;
+}
+
+// 客户端：把目标和自己的标准输出/错误交给守护进程，等待退出状态。
+// 没有运行中的守护进程时返回-1，由调用者改为本地构建
+int daemon_client(int jobs, const char** goals, int goal_count) {
+    int fd = connect_daemon();
+    if (fd < 0) {
+        return -1;
+    }
+
+    char* message = (char*)malloc(DAEMON_MESSAGE_MAX);
+    int length = snprintf(message, DAEMON_MESSAGE_MAX, "jobs %d\n", jobs);
+    for (int i = 0; i < goal_count && length < DAEMON_MESSAGE_MAX; i++) {
+        length += snprintf(message + length, DAEMON_MESSAGE_MAX - length, "goal %s\n", goals[i]);
+    }
+    if (length >= DAEMON_MESSAGE_MAX) {
+        printf("错误: 请求过长\n");
+        free(message);
+        close(fd);
+        return 1;
+    }
+
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { message, (size_t)length };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+        perror("错误: 无法发送请求");
+        free(message);
+        close(fd);
+        return 1;
+    }
+    free(message);
+
+    char reply[64];
+    ssize_t n;
+    do {
+        n = recv(fd, reply, sizeof(reply) - 1, 0);
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    int status;
+    if (n <= 0 || (reply[n] = '\0', sscanf(reply, "status %d", &status) != 1)) {
+        printf("错误: 与守护进程的连接中断\n");
+        return 1;
+    }
+    return status;
+}
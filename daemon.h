@@ -0,0 +1,12 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "level2.h"
+
+#define DAEMON_SOCKET ".minimake.sock"   // 守护进程监听的Unix套接字(位于项目目录)
+#define DAEMON_MESSAGE_MAX 65536         // 一个请求消息的最大长度
+
+int daemon_serve(MakefileData* data, const char* makefile_path);
+int daemon_client(int jobs, const char** goals, int goal_count);
+
+#endif
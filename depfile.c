@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "depfile.h"
+#include "level3.h"
+#include "level5.h"
+
+// 编译器生成的depfile(gcc -MMD)：include指令列出的文件不经过通用的Makefile解析，
+// 由专用的解析器读出"目标: 依赖..."，依赖边在建依赖图时直接并入(头文件依赖无需手写)。
+// 解析结果按depfile路径记入二进制日志.minimake.deps，depfile的大小和mtime未变时直接取用日志，
+// 成千上万个depfile每次构建只需stat，不必重新读取和解析
+
+#define DEPFILE_LOG_MAGIC "MMKDEPS1"
+
+// 日志格式：魔数、uint32记录数，之后每条记录为
+//   字符串 depfile路径 | int64 大小 | int64 mtime秒 | int64 mtime纳秒 | uint32 内容字节数 | 内容
+// 内容为 uint32 条目数，每个条目为 字符串 目标 | uint32 依赖数 | 依赖字符串...
+// 字符串为 uint32 长度 | 字节 | '\0'。整数按本机字节序，读取时不要求对齐
+
+// 字节缓冲区：新日志和解析出的记录在内存中组装
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} ByteBuffer;
+
+static void bytes_append(ByteBuffer *buf, const void *src, size_t len) {
+    if (buf->len + len > buf->capacity) {
+        size_t capacity = buf->capacity > 0 ? buf->capacity : 4096;
+        while (buf->len + len > capacity) {
+            capacity *= 2;
+        }
+        buf->data = (char *)realloc(buf->data, capacity);
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->len, src, len);
+    buf->len += len;
+}
+
+static void bytes_put_u32(ByteBuffer *buf, uint32_t value) {
+    bytes_append(buf, &value, sizeof(value));
+}
+
+static void bytes_put_i64(ByteBuffer *buf, int64_t value) {
+    bytes_append(buf, &value, sizeof(value));
+}
+
+static void bytes_put_string(ByteBuffer *buf, const char *str, size_t len) {
+    bytes_put_u32(buf, (uint32_t)len);
+    bytes_append(buf, str, len);
+    bytes_append(buf, "", 1);
+}
+
+// 按位置读取，越界时返回0
+static int read_u32(const char **p, const char *end, uint32_t *value) {
+    if ((size_t)(end - *p) < sizeof(uint32_t)) {
+        return 0;
+    }
+    memcpy(value, *p, sizeof(uint32_t));
+    *p += sizeof(uint32_t);
+    return 1;
+}
+
+static int read_i64(const char **p, const char *end, int64_t *value) {
+    if ((size_t)(end - *p) < sizeof(int64_t)) {
+        return 0;
+    }
+    memcpy(value, *p, sizeof(int64_t));
+    *p += sizeof(int64_t);
+    return 1;
+}
+
+static int read_string(const char **p, const char *end, const char **str, uint32_t *len) {
+    if (!read_u32(p, end, len) || (size_t)(end - *p) < (size_t)*len + 1 || (*p)[*len] != '\0') {
+        return 0;
+    }
+    *str = *p;
+    *p += *len + 1;
+    return 1;
+}
+
+// 检查记录内容的结构完整
+static int valid_body(const char *p, const char *end) {
+    uint32_t entries, deps, len;
+    const char *str;
+    if (!read_u32(&p, end, &entries)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < entries; i++) {
+        if (!read_string(&p, end, &str, &len) || !read_u32(&p, end, &deps)) {
+            return 0;
+        }
+        for (uint32_t j = 0; j < deps; j++) {
+            if (!read_string(&p, end, &str, &len)) {
+                return 0;
+            }
+        }
+    }
+    return p == end;
+}
+
+// 映射的旧日志：按depfile路径索引各条记录
+typedef struct {
+    const char *map;
+    size_t size;
+    const char **paths;      // 各记录的depfile路径(指向映射内容)
+    const char **records;    // 各记录的起始位置
+    int count;
+    HashIndex index;         // 路径 -> 记录下标
+} DepfileLog;
+
+static const char *log_path_key(const void *ctx, int idx) {
+    return ((const DepfileLog *)ctx)->paths[idx];
+}
+
+static void log_close(DepfileLog *log) {
+    if (log->map != NULL) {
+        munmap((void *)log->map, log->size);
+    }
+    free(log->paths);
+    free(log->records);
+    hash_index_free(&log->index);
+}
+
+// 日志已损坏：给出警告，按空日志处理(全部depfile重新解析，并写出新日志)
+static void log_corrupt(const char *path) {
+    printf("警告: depfile日志 %s 已损坏，重新解析全部depfile\n", path);
+}
+
+// 映射并校验日志，文件不存在或已损坏时得到空日志
+static void log_open(DepfileLog *log, const char *path) {
+    memset(log, 0, sizeof(DepfileLog));
+    hash_index_init(&log->index, log_path_key, log);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(DEPFILE_LOG_MAGIC) - 1 + sizeof(uint32_t))) {
+        log_corrupt(path);
+        close(fd);
+        return;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    const char *p = (const char *)map + sizeof(DEPFILE_LOG_MAGIC) - 1;
+    const char *end = (const char *)map + st.st_size;
+    uint32_t count;
+    if (memcmp(map, DEPFILE_LOG_MAGIC, sizeof(DEPFILE_LOG_MAGIC) - 1) != 0 || !read_u32(&p, end, &count)
+        || count > (uint32_t)(end - p)) {
+        log_corrupt(path);
+        munmap(map, st.st_size);
+        return;
+    }
+    log->paths = (const char **)malloc((count > 0 ? count : 1) * sizeof(char *));
+    log->records = (const char **)malloc((count > 0 ? count : 1) * sizeof(char *));
+    for (uint32_t i = 0; i < count; i++) {
+        const char *record = p;
+        const char *path_str;
+        uint32_t path_len, body_len;
+        int64_t meta;
+        if (!read_string(&p, end, &path_str, &path_len) || !read_i64(&p, end, &meta)
+            || !read_i64(&p, end, &meta) || !read_i64(&p, end, &meta) || !read_u32(&p, end, &body_len)
+            || (size_t)(end - p) < body_len || !valid_body(p, p + body_len)) {
+            log_corrupt(path);
+            free(log->paths);
+            free(log->records);
+            hash_index_free(&log->index);
+            munmap(map, st.st_size);
+            memset(log, 0, sizeof(DepfileLog));
+            hash_index_init(&log->index, log_path_key, log);
+            return;
+        }
+        p += body_len;
+        log->paths[i] = path_str;
+        log->records[i] = record;
+        if (hash_index_find(&log->index, path_str) == -1) {
+            hash_index_insert(&log->index, path_str, (int)i);
+        }
+        log->count++;
+    }
+    log->map = (const char *)map;
+    log->size = st.st_size;
+}
+
+// 收集依赖边时的状态：用标记数组去掉与规则依赖或同一条目内重复的边
+typedef struct {
+    MakefileData *data;
+    DepfileEdges *out;
+    unsigned *marks;         // 符号 -> 最近一次标记它的条目编号
+    int mark_capacity;
+    unsigned stamp;
+} EdgeCollector;
+
+static void mark_symbol(EdgeCollector *c, SymbolId symbol) {
+    if ((int)symbol >= c->mark_capacity) {
+        int old_capacity = c->mark_capacity;
+        int capacity = old_capacity > 0 ? old_capacity : 64;
+        while ((int)symbol >= capacity) {
+            capacity *= 2;
+        }
+        c->marks = (unsigned *)realloc(c->marks, capacity * sizeof(unsigned));
+        memset(c->marks + old_capacity, 0, (capacity - old_capacity) * sizeof(unsigned));
+        c->mark_capacity = capacity;
+    }
+    c->marks[symbol] = c->stamp;
+}
+
+static int is_marked(const EdgeCollector *c, SymbolId symbol) {
+    return (int)symbol < c->mark_capacity && c->marks[symbol] == c->stamp;
+}
+
+// 把一条记录内容中的条目转成依赖边。没有规则的目标(如已删除的目标文件留下的depfile)忽略，
+// 其依赖也不驻留。内容不完整时停止并返回0
+static int collect_body(EdgeCollector *c, const char *p, const char *end) {
+    MakefileData *data = c->data;
+    uint32_t entries, deps, len;
+    const char *str;
+    if (!read_u32(&p, end, &entries)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < entries; i++) {
+        if (!read_string(&p, end, &str, &len) || !read_u32(&p, end, &deps)) {
+            return 0;
+        }
+        int target = lookup_symbol(&data->symbols, str);
+        Rule *rule = target == -1 ? NULL : find_rule_by_symbol(data, (SymbolId)target);
+        c->stamp++;
+        if (rule != NULL) {
+            mark_symbol(c, (SymbolId)target);
+            for (int j = 0; j < rule->dep_count; j++) {
+                mark_symbol(c, rule->dependencies[j]);
+            }
+        }
+        for (uint32_t j = 0; j < deps; j++) {
+            if (!read_string(&p, end, &str, &len)) {
+                return 0;
+            }
+            if (rule == NULL) {
+                continue;
+            }
+            SymbolId dep = intern_symbol_n(&data->symbols, str, len);
+            if (is_marked(c, dep)) {
+                continue;
+            }
+            mark_symbol(c, dep);
+            DepfileEdges *out = c->out;
+            if (out->count == out->capacity) {
+                out->capacity = out->capacity > 0 ? out->capacity * 2 : 256;
+                out->edges = (DepfileEdge *)realloc(out->edges, out->capacity * sizeof(DepfileEdge));
+            }
+            out->edges[out->count].target = (SymbolId)target;
+            out->edges[out->count].dep = dep;
+            out->count++;
+        }
+    }
+    return p == end;
+}
+
+// 一个条目中暂存的名称：以'\0'分隔依次存放
+typedef struct {
+    ByteBuffer names;
+    int count;
+} NameList;
+
+static void name_list_add(NameList *list, const ByteBuffer *token) {
+    bytes_append(&list->names, token->data, token->len);
+    bytes_append(&list->names, "", 1);
+    list->count++;
+}
+
+// 条目结束：每个目标各写一个条目(依赖相同)，没有依赖的条目(-MP生成的头文件伪目标)不写
+static void flush_entry(ByteBuffer *body, uint32_t *entry_count, NameList *targets, NameList *deps) {
+    if (targets->count > 0 && deps->count > 0) {
+        const char *target = targets->names.data;
+        for (int i = 0; i < targets->count; i++) {
+            size_t target_len = strlen(target);
+            bytes_put_string(body, target, target_len);
+            bytes_put_u32(body, (uint32_t)deps->count);
+            const char *dep = deps->names.data;
+            for (int j = 0; j < deps->count; j++) {
+                size_t dep_len = strlen(dep);
+                bytes_put_string(body, dep, dep_len);
+                dep += dep_len + 1;
+            }
+            target += target_len + 1;
+        }
+        *entry_count += targets->count;
+    }
+    targets->names.len = 0;
+    targets->count = 0;
+    deps->names.len = 0;
+    deps->count = 0;
+}
+
+// 解析depfile文本，把记录内容追加到body。格式为 "目标...: 依赖..."，
+// 反斜杠加换行是续行，"\ "是名称中的空格，"\#"是#，"$$"是$，未转义的#开始注释
+static void parse_depfile_text(const char *text, size_t size, ByteBuffer *body) {
+    size_t count_pos = body->len;
+    uint32_t entry_count = 0;
+    bytes_put_u32(body, 0);  // 条目数，解析完后回填
+
+    ByteBuffer token = {0};
+    NameList targets = {{0}, 0};
+    NameList deps = {{0}, 0};
+    int in_deps = 0;   // 当前条目是否已读过冒号
+    const char *p = text;
+    const char *end = text + size;
+    while (p <= end) {
+        char ch = p < end ? *p : '\n';  // 文件末尾按换行处理
+        int token_end = 0;
+        int entry_end = 0;
+        if (ch == '\\' && p + 1 < end && (p[1] == '\n' || (p[1] == '\r' && p + 2 < end && p[2] == '\n'))) {
+            p += p[1] == '\n' ? 2 : 3;  // 续行
+            token_end = 1;
+        } else if (ch == '\\' && p + 1 < end && (p[1] == ' ' || p[1] == '#' || p[1] == '\\')) {
+            bytes_append(&token, p + 1, 1);
+            p += 2;
+        } else if (ch == '$' && p + 1 < end && p[1] == '$') {
+            bytes_append(&token, "$", 1);
+            p += 2;
+        } else if (ch == '#') {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+            token_end = 1;
+        } else if (ch == '\n') {
+            p++;
+            token_end = 1;
+            entry_end = 1;
+        } else if (ch == ' ' || ch == '\t' || ch == '\r') {
+            p++;
+            token_end = 1;
+        } else if (ch == ':' && !in_deps && (p + 1 >= end || isspace((unsigned char)p[1]))) {
+            p++;
+            if (token.len > 0) {
+                name_list_add(&targets, &token);
+                token.len = 0;
+            }
+            in_deps = 1;
+        } else {
+            bytes_append(&token, p, 1);
+            p++;
+        }
+        if (token_end && token.len > 0) {
+            name_list_add(in_deps ? &deps : &targets, &token);
+            token.len = 0;
+        }
+        if (entry_end) {
+            if (in_deps) {
+                flush_entry(body, &entry_count, &targets, &deps);
+            } else {
+                targets.names.len = 0;  // 没有冒号的行不是规则
+                targets.count = 0;
+            }
+            in_deps = 0;
+        }
+    }
+    memcpy(body->data + count_pos, &entry_count, sizeof(entry_count));
+    free(token.data);
+    free(targets.names.data);
+    free(deps.names.data);
+}
+
+// 读入整个文件到buffer(按需扩容)，成功返回1
+static int read_whole_file(const char *path, ByteBuffer *buffer) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    buffer->len = 0;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        bytes_append(buffer, chunk, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+// 一次收集过程的状态
+typedef struct {
+    EdgeCollector collector;
+    DepfileLog log;
+    ByteBuffer new_log;      // 本次用到的全部depfile的记录
+    uint32_t record_count;
+    int changed;             // 新日志与旧日志内容不同
+    ByteBuffer text;         // depfile文本(重复使用)
+} DepfileScan;
+
+// 读取一个depfile：大小和mtime与日志记录一致时复制日志中的记录，否则重新解析
+static void scan_depfile(DepfileScan *scan, const char *path, bool optional, int line_num) {
+    MakefileData *data = scan->collector.data;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        if (!optional) {
+            add_error(data, "错误: 无法读取依赖文件 %s (行号: %d)", path, line_num);
+        }
+        return;
+    }
+    scan->collector.out->file_count++;
+    scan->record_count++;
+
+    int idx = hash_index_find(&scan->log.index, path);
+    if (idx != -1) {
+        const char *p = scan->log.records[idx];
+        const char *end = scan->log.map + scan->log.size;
+        const char *path_str;
+        uint32_t path_len, body_len;
+        int64_t size, mtime_sec, mtime_nsec;
+        if (read_string(&p, end, &path_str, &path_len) && read_i64(&p, end, &size)
+            && read_i64(&p, end, &mtime_sec) && read_i64(&p, end, &mtime_nsec)
+            && read_u32(&p, end, &body_len) && (size_t)(end - p) >= body_len
+            && size == (int64_t)st.st_size && mtime_sec == (int64_t)st.st_mtim.tv_sec
+            && mtime_nsec == (int64_t)st.st_mtim.tv_nsec) {
+            if (collect_body(&scan->collector, p, p + body_len)) {
+                bytes_append(&scan->new_log, scan->log.records[idx], p + body_len - scan->log.records[idx]);
+            } else {
+                scan->changed = 1;  // 记录已损坏，不写入新日志，下次重新解析
+                scan->record_count--;
+            }
+            return;
+        }
+    }
+
+    scan->changed = 1;
+    if (!read_whole_file(path, &scan->text)) {
+        // 读不出的depfile不写入新日志，下次重新读取
+        if (!optional) {
+            add_error(data, "错误: 无法读取依赖文件 %s (行号: %d)", path, line_num);
+        } else {
+            printf("警告: 无法读取依赖文件 %s，忽略\n", path);
+        }
+        scan->collector.out->file_count--;
+        scan->record_count--;
+        return;
+    }
+    scan->collector.out->parsed_count++;
+    bytes_put_string(&scan->new_log, path, strlen(path));
+    bytes_put_i64(&scan->new_log, (int64_t)st.st_size);
+    bytes_put_i64(&scan->new_log, (int64_t)st.st_mtim.tv_sec);
+    bytes_put_i64(&scan->new_log, (int64_t)st.st_mtim.tv_nsec);
+    size_t length_pos = scan->new_log.len;
+    bytes_put_u32(&scan->new_log, 0);  // 内容字节数，解析完后回填
+    size_t body_start = scan->new_log.len;
+    parse_depfile_text(scan->text.data, scan->text.len, &scan->new_log);
+    uint32_t body_len = (uint32_t)(scan->new_log.len - body_start);
+    memcpy(scan->new_log.data + length_pos, &body_len, sizeof(body_len));
+    collect_body(&scan->collector, scan->new_log.data + body_start, scan->new_log.data + scan->new_log.len);
+}
+
+// 写入新日志(先写临时文件再改名)
+static void write_log(const char *path, ByteBuffer *new_log, uint32_t record_count) {
+    memcpy(new_log->data + sizeof(DEPFILE_LOG_MAGIC) - 1, &record_count, sizeof(record_count));
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        perror("警告：无法写入depfile日志");
+        return;
+    }
+    fwrite(new_log->data, 1, new_log->len, file);
+    int write_failed = ferror(file);
+    if (fclose(file) != 0 || write_failed || rename(tmp_path, path) != 0) {
+        perror("警告：无法写入depfile日志");
+        unlink(tmp_path);
+    }
+}
+
+// 记录一条include指令：文件列表中的变量现在展开，文件在建依赖图时才读取。
+// 只支持编译器生成的depfile(*.d，可含通配符)；其他文件(如 include common.mk)中的变量和规则
+// 无法用depfile解析器读出，报告为不支持而不是静默丢弃
+void add_depfile_include(MakefileData *data, StrView files, bool optional, int line_num) {
+    if (view_find(files, '$') != NULL) {
+        files.ptr = expand_variable(data, files.ptr, files.len, &files.len, line_num);
+    }
+    char *accepted = arena_alloc(&data->arena, files.len + 1);
+    size_t accepted_len = 0;
+    const char *end = files.ptr + files.len;
+    for (const char *p = files.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        const char *word = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        size_t len = p - word;
+        if (len < 3 || memcmp(p - 2, ".d", 2) != 0) {
+            add_error(data, "Line%d: include '%.*s' not supported (only compiler depfiles *.d)",
+                      line_num, (int)len, word);
+            continue;
+        }
+        if (accepted_len > 0) {
+            accepted[accepted_len++] = ' ';
+        }
+        memcpy(accepted + accepted_len, word, len);
+        accepted_len += len;
+    }
+    accepted[accepted_len] = '\0';
+    if (accepted_len == 0) {
+        return;
+    }
+    data->includes = arena_reserve(&data->arena, data->includes, &data->include_capacity,
+                                   data->include_count, sizeof(DepfileInclude));
+    DepfileInclude *include = &data->includes[data->include_count++];
+    include->files = accepted;
+    include->line_num = line_num;
+    include->optional = optional;
+}
+
+// 读取include指令列出的全部depfile(文件名含通配符时按glob展开)，依赖边写入out。
+// 返回0表示成功，有必需的depfile无法读取时记录错误并返回1
+int depfile_collect(MakefileData *data, const char *log_path, DepfileEdges *out) {
+    memset(out, 0, sizeof(DepfileEdges));
+    if (data->include_count == 0) {
+        return 0;
+    }
+    int errors_before = data->error_count;
+    DepfileScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.collector.data = data;
+    scan.collector.out = out;
+    log_open(&scan.log, log_path);
+    bytes_append(&scan.new_log, DEPFILE_LOG_MAGIC, sizeof(DEPFILE_LOG_MAGIC) - 1);
+    bytes_put_u32(&scan.new_log, 0);  // 记录数，写入时回填
+
+    for (int i = 0; i < data->include_count; i++) {
+        const DepfileInclude *include = &data->includes[i];
+        const char *p = include->files;
+        while (*p != '\0') {
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == '\0') break;
+            const char *start = p;
+            while (*p != '\0' && !isspace((unsigned char)*p)) p++;
+            char *word = strndup(start, p - start);
+            glob_t matches;
+            if (strpbrk(word, "*?[") == NULL) {
+                scan_depfile(&scan, word, include->optional, include->line_num);
+            } else if (glob(word, 0, NULL, &matches) == 0) {
+                for (size_t j = 0; j < matches.gl_pathc; j++) {
+                    scan_depfile(&scan, matches.gl_pathv[j], include->optional, include->line_num);
+                }
+                globfree(&matches);
+            } else {
+                scan_depfile(&scan, word, include->optional, include->line_num);  // 没有匹配的文件
+            }
+            free(word);
+        }
+    }
+
+    out->changed = scan.changed || scan.record_count != (uint32_t)scan.log.count;
+    if (out->changed) {
+        write_log(log_path, &scan.new_log, scan.record_count);
+    }
+    printf("读取depfile %d 个 (重新解析 %d 个)，头文件依赖 %d 条\n",
+           out->file_count, out->parsed_count, out->count);
+
+    log_close(&scan.log);
+    free(scan.new_log.data);
+    free(scan.text.data);
+    free(scan.collector.marks);
+    return data->error_count > errors_before;
+}
+
+void depfile_edges_free(DepfileEdges *edges) {
+    free(edges->edges);
+    edges->edges = NULL;
+    edges->count = 0;
+    edges->capacity = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef DEPFILE_H
+#define DEPFILE_H
+
+#include "level2.h"
+
+#define DEPFILE_LOG_FILE ".minimake.deps"  // 已解析depfile内容的二进制日志(位于当前目录)
+
+// depfile中的一条依赖边(依赖 -> 目标)，只收集已有规则的目标
+typedef struct {
+    SymbolId target;
+    SymbolId dep;
+} DepfileEdge;
+
+// 本次读取的全部depfile依赖边及统计
+typedef struct {
+    DepfileEdge *edges;
+    int count;
+    int capacity;
+    int file_count;      // 读取的depfile数
+    int parsed_count;    // 内容有变化、重新解析的depfile数(其余取自日志)
+    int changed;         // 与上次读取相比有depfile新增、删除或内容改变
+} DepfileEdges;
+
+void add_depfile_include(MakefileData *data, StrView files, bool optional, int line_num);
+int depfile_collect(MakefileData *data, const char *log_path, DepfileEdges *out);
+void depfile_edges_free(DepfileEdges *edges);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash_index.h"
+
+#define HASH_INITIAL_CAPACITY 64  // 初始槽数量
+
+// FNV-1a字符串哈希
+unsigned int hash_string(const char* str) {
+    return hash_string_n(str, strlen(str));
+}
+
+// 对长度为len的字符串片段计算哈希(与hash_string结果一致)
+unsigned int hash_string_n(const char* str, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 初始化哈希索引，key_of用于根据下标取回键进行比较
+void hash_index_init(HashIndex* index, HashKeyFunc key_of, const void* ctx) {
+    index->capacity = HASH_INITIAL_CAPACITY;
+    index->count = 0;
+    index->slots = (int*)calloc(index->capacity, sizeof(int));
+    index->key_of = key_of;
+    index->ctx = ctx;
+}
+
+// 查找键对应的下标，未找到返回-1
+int hash_index_find(const HashIndex* index, const char* key) {
+    return hash_index_find_n(index, key, strlen(key));
+}
+
+// 查找长度为len的键(不要求以'\0'结尾)，未找到返回-1
+int hash_index_find_n(const HashIndex* index, const char* key, size_t len) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int pos = hash_string_n(key, len) & mask;
+    while (index->slots[pos] != 0) {
+        int idx = index->slots[pos] - 1;
+        const char* stored = index->key_of(index->ctx, idx);
+        if (strncmp(stored, key, len) == 0 && stored[len] == '\0') {
+            return idx;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+// 仅放入槽位，不检查重复(扩容重建时使用)
+static void place_slot(HashIndex* index, const char* key, int idx) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int pos = hash_string(key) & mask;
+    while (index->slots[pos] != 0) {
+        pos = (pos + 1) & mask;
+    }
+    index->slots[pos] = idx + 1;
+}
+
+// 插入键与下标的映射(调用方保证键不重复)；负载超过1/2时扩容一倍
+void hash_index_insert(HashIndex* index, const char* key, int idx) {
+    if ((index->count + 1) * 2 > index->capacity) {
+        int old_capacity = index->capacity;
+        int* old_slots = index->slots;
+        index->capacity *= 2;
+        index->slots = (int*)calloc(index->capacity, sizeof(int));
+        for (int i = 0; i < old_capacity; i++) {
+            if (old_slots[i] != 0) {
+                int old_idx = old_slots[i] - 1;
+                place_slot(index, index->key_of(index->ctx, old_idx), old_idx);
+            }
+        }
+        free(old_slots);
+    }
+    place_slot(index, key, idx);
+    index->count++;
+}
+
+// 释放哈希索引
+void hash_index_free(HashIndex* index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
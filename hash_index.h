@@ -0,0 +1,26 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stddef.h>
+
+// 根据元素下标取出其键(字符串)的回调，ctx为调用方的数据结构
+typedef const char* (*HashKeyFunc)(const void* ctx, int idx);
+
+// 开放寻址(线性探测)哈希索引：槽中只存元素下标，键由回调从原数据中取得
+typedef struct {
+    int* slots;        // 存储下标+1，0表示空槽
+    int capacity;      // 槽数量(2的幂)
+    int count;         // 已插入元素数
+    HashKeyFunc key_of;
+    const void* ctx;
+} HashIndex;
+
+unsigned int hash_string(const char* str);
+unsigned int hash_string_n(const char* str, size_t len);
+void hash_index_init(HashIndex* index, HashKeyFunc key_of, const void* ctx);
+int hash_index_find(const HashIndex* index, const char* key);
+int hash_index_find_n(const HashIndex* index, const char* key, size_t len);
+void hash_index_insert(HashIndex* index, const char* key, int idx);
+void hash_index_free(HashIndex* index);
+
+#endif
@@ -0,0 +1,237 @@
+#define _GNU_SOURCE  // F_GETPIPE_SZ、F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "jobserver.h"
+
+// GNU make兼容的jobserver：令牌是管道(或命名管道)中的字节，每个进程自带一个隐含令牌，
+// 同时运行的第2个及以后的任务各需要先读出一个令牌，结束后写回。
+// 嵌套的make/minimake通过MAKEFLAGS中的--jobserver-auth共享同一个并发预算
+typedef struct {
+    int active;        // 是否连接到jobserver
+    int owner;         // jobserver是否由本进程创建
+    int read_fd;       // 非阻塞读端(本进程独立的打开文件描述，不影响其他进程)
+    int write_fd;      // 写回令牌的描述符
+    int close_write;   // write_fd是否由本进程打开(需要在结束时关闭)
+    int pipe_fds[2];   // 本进程创建的管道(供子进程继承)
+    char* held;        // 已取得的令牌字节(按原样写回)
+    int held_count;
+    int held_capacity;
+    char* saved_flags; // 创建jobserver前的MAKEFLAGS(关闭时恢复，NULL表示原先未设置)
+} Jobserver;
+
+static Jobserver server = { 0, 0, -1, -1, 0, { -1, -1 }, NULL, 0, 0, NULL };
+
+// 以非阻塞方式重新打开读端：O_NONBLOCK作用于打开文件描述，
+// 直接对继承来的描述符设置会影响共享管道的其他进程
+static int open_nonblocking(const char* path) {
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+// 从MAKEFLAGS中解析外部jobserver(--jobserver-auth=R,W、fifo:PATH或旧式--jobserver-fds=R,W)
+static int connect_client(void) {
+    const char* flags = getenv("MAKEFLAGS");
+    if (flags == NULL) {
+        return 0;
+    }
+    const char* auth = NULL;
+    const char* keys[] = { "--jobserver-auth=", "--jobserver-fds=", NULL };
+    for (int i = 0; keys[i] != NULL; i++) {
+        // 取最后一次出现的设置(外层make可能追加)
+        for (const char* p = strstr(flags, keys[i]); p != NULL; p = strstr(p + 1, keys[i])) {
+            auth = p + strlen(keys[i]);
+        }
+        if (auth != NULL) {
+            break;
+        }
+    }
+    if (auth == NULL) {
+        return 0;
+    }
+
+    char value[4096];
+    size_t len = strcspn(auth, " \t");
+    if (len >= sizeof(value)) {
+        return 0;
+    }
+    memcpy(value, auth, len);
+    value[len] = '\0';
+
+    if (strncmp(value, "fifo:", 5) == 0) {
+        server.read_fd = open_nonblocking(value + 5);
+        server.write_fd = open(value + 5, O_WRONLY | O_CLOEXEC);
+        server.close_write = 1;
+    } else {
+        int read_fd, write_fd;
+        if (sscanf(value, "%d,%d", &read_fd, &write_fd) != 2
+            || fcntl(read_fd, F_GETFD) == -1 || fcntl(write_fd, F_GETFD) == -1) {
+            printf("警告: MAKEFLAGS中的jobserver描述符 '%s' 不可用，忽略\n", value);
+            return 0;
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", read_fd);
+        server.read_fd = open_nonblocking(path);
+        server.write_fd = write_fd;
+    }
+    if (server.read_fd < 0 || server.write_fd < 0) {
+        printf("警告: 无法连接jobserver '%s'，忽略\n", value);
+        if (server.read_fd >= 0) {
+            close(server.read_fd);
+        }
+        if (server.close_write && server.write_fd >= 0) {
+            close(server.write_fd);
+        }
+        server.read_fd = -1;
+        server.write_fd = -1;
+        server.close_write = 0;
+        return 0;
+    }
+    server.active = 1;
+    printf("使用外部jobserver (%s)\n", value);
+    return 1;
+}
+
+// 管道能放下的令牌数。管道按页缓存，取走令牌的页在读空前不能复用，
+// 令牌在管道中循环时最多占用两页不完整的缓存，因此留出两页余量
+static int pipe_token_capacity(int fd) {
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    long page = sysconf(_SC_PAGESIZE);
+    return size < 0 ? -1 : (int)(size > 2 * page ? size - 2 * page : 0);
+}
+
+// 作为顶层构建创建jobserver：管道中放入jobs-1个令牌，并通过MAKEFLAGS导出给子进程。
+// 令牌在没有读者时写入，管道容量不够时写操作会永远阻塞，因此先按令牌数扩大管道，
+// 仍然放不下时把并发数限制为管道能容纳的令牌数+1
+static int create_server(int jobs) {
+    if (pipe(server.pipe_fds) != 0) {
+        perror("警告: 无法创建jobserver管道");
+        return 0;
+    }
+    int capacity = pipe_token_capacity(server.pipe_fds[1]);
+    if (capacity >= 0 && capacity < jobs - 1) {
+        long page = sysconf(_SC_PAGESIZE);
+        long wanted = (long)jobs - 1 + 2 * page;
+        fcntl(server.pipe_fds[1], F_SETPIPE_SZ, wanted < INT_MAX ? (int)wanted : INT_MAX);
+        capacity = pipe_token_capacity(server.pipe_fds[1]);
+    }
+    if (capacity >= 0 && capacity < jobs - 1) {
+        printf("警告: jobserver管道只能容纳 %d 个令牌，并发数限制为 %d\n", capacity, capacity + 1);
+        jobs = capacity + 1;
+    }
+    for (int i = 0; i < jobs - 1; i++) {
+        char token = JOBSERVER_TOKEN;
+        if (write(server.pipe_fds[1], &token, 1) != 1) {
+            perror("警告: 无法写入jobserver令牌");
+            close(server.pipe_fds[0]);
+            close(server.pipe_fds[1]);
+            return 0;
+        }
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", server.pipe_fds[0]);
+    server.read_fd = open_nonblocking(path);
+    if (server.read_fd < 0) {
+        perror("警告: 无法打开jobserver管道");
+        close(server.pipe_fds[0]);
+        close(server.pipe_fds[1]);
+        return 0;
+    }
+    server.write_fd = server.pipe_fds[1];
+
+    // 保留已有的MAKEFLAGS内容，追加并行参数和jobserver描述符
+    const char* old_flags = getenv("MAKEFLAGS");
+    free(server.saved_flags);
+    server.saved_flags = old_flags != NULL ? strdup(old_flags) : NULL;
+    char flags[8192];
+    snprintf(flags, sizeof(flags), "%s%s-j%d --jobserver-auth=%d,%d",
+             old_flags != NULL ? old_flags : "", old_flags != NULL && *old_flags ? " " : "",
+             jobs, server.pipe_fds[0], server.pipe_fds[1]);
+    setenv("MAKEFLAGS", flags, 1);
+    server.owner = 1;
+    server.active = 1;
+    return 1;
+}
+
+// 初始化jobserver：MAKEFLAGS中已有jobserver时作为客户端加入，
+// 否则在并行构建(jobs>1)时创建自己的jobserver。返回是否启用
+int jobserver_setup(int jobs) {
+    if (connect_client()) {
+        return 1;
+    }
+    if (jobs > 1) {
+        return create_server(jobs);
+    }
+    return 0;
+}
+
+// 尝试取得一个令牌(不阻塞)，成功返回1。未启用jobserver时总是成功，并发只受-j限制
+int jobserver_try_acquire(void) {
+    if (!server.active) {
+        return 1;
+    }
+    char token;
+    ssize_t n;
+    do {
+        n = read(server.read_fd, &token, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) {
+        return 0;  // 暂时没有可用令牌(EAGAIN)
+    }
+    if (server.held_count == server.held_capacity) {
+        server.held_capacity = server.held_capacity > 0 ? server.held_capacity * 2 : 8;
+        server.held = (char*)realloc(server.held, server.held_capacity);
+    }
+    server.held[server.held_count++] = token;
+    return 1;
+}
+
+// 归还一个令牌(写回取得时的字节)
+void jobserver_release(void) {
+    if (!server.active || server.held_count == 0) {
+        return;
+    }
+    char token = server.held[--server.held_count];
+    ssize_t n;
+    do {
+        n = write(server.write_fd, &token, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) {
+        perror("警告: 无法归还jobserver令牌");
+    }
+}
+
+// 归还所有令牌并关闭描述符
+void jobserver_shutdown(void) {
+    while (server.held_count > 0) {
+        jobserver_release();
+    }
+    if (server.read_fd >= 0) {
+        close(server.read_fd);
+    }
+    if (server.owner) {
+        close(server.pipe_fds[0]);
+        close(server.pipe_fds[1]);
+        // 恢复MAKEFLAGS，之后(例如守护进程的下一个请求)不再引用已关闭的管道
+        if (server.saved_flags != NULL) {
+            setenv("MAKEFLAGS", server.saved_flags, 1);
+        } else {
+            unsetenv("MAKEFLAGS");
+        }
+        free(server.saved_flags);
+        server.saved_flags = NULL;
+    } else if (server.close_write) {
+        close(server.write_fd);  // 外部jobserver继承来的管道描述符不属于本进程，不关闭
+    }
+    free(server.held);
+    server.held = NULL;
+    server.held_capacity = 0;
+    server.active = 0;
+    server.owner = 0;
+    server.read_fd = -1;
+    server.write_fd = -1;
+    server.close_write = 0;
+}
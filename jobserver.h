@@ -0,0 +1,11 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#define JOBSERVER_TOKEN '+'   // 本进程创建的jobserver写入的令牌字符
+
+int jobserver_setup(int jobs);
+int jobserver_try_acquire(void);
+void jobserver_release(void);
+void jobserver_shutdown(void);
+
+#endif
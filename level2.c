@@ -5,12 +5,11 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include "level2.h"
+#include "level3.h"
 #include "level5.h"
-#define MAX_LINE_LENGTH 1024
-#define MAX_TARGETS 100       // 最大目标数量
-#define MAX_DEPENDENCIES 50   // 每个目标最大依赖数量
-#define MAX_COMMANDS 20       // 每个目标最大命令数量
-#define MAX_FILENAME_LEN 33   // 文件名最大长度(含结束符)
+#include "pattern_rules.h"
+#include "depfile.h"
+#include "preprocessing.h"
 
 // 第一次编译临时函数：执行指定目标的命令
 int execute_target(MakefileData *data, const char *target_name) {
@@ -21,7 +20,7 @@ int execute_target(MakefileData *data, const char *target_name) {
     }
     
     Rule *target = &data->rules[target_index];
-    printf("正在执行目标: %s\n", target->target);
+    printf("正在执行目标: %s\n", target_name);
     
     // 依次执行目标的所有命令
     for (int i = 0; i < target->cmd_count; i++) {
@@ -33,22 +32,57 @@ int execute_target(MakefileData *data, const char *target_name) {
         }
     }
     
-    printf("目标 '%s' 执行完成\n", target->target);
+    printf("目标 '%s' 执行完成\n", target_name);
     return 0;
 }
   
   
   
-// 初始化Makefile数据结构
+// 初始化Makefile数据结构(规则和变量数组在解析时按需在arena中分配)
 void init_makefile_data(MakefileData *data) {
+    arena_init(&data->arena);
+    data->rules = NULL;
     data->rule_count = 0;
+    data->rule_capacity = 0;
     data->error_count = 0;
-    memset(data->rules, 0, sizeof(data->rules));
     memset(data->errors, 0, sizeof(data->errors));
     
     //初始化变量存储
-    data->var_count = 0;
-    memset(data->variables, 0, sizeof(data->variables));
+    init_variables(data);
+
+    symbol_table_init(&data->symbols, &data->arena);
+    data->rule_of_symbol = NULL;
+    data->rule_of_symbol_capacity = 0;
+    data->cache = NULL;
+
+    data->oneshell_all = false;
+    data->oneshell_targets = NULL;
+    data->oneshell_count = 0;
+    data->oneshell_capacity = 0;
+
+    pattern_rules_init(data);
+    data->includes = NULL;
+    data->include_count = 0;
+    data->include_capacity = 0;
+    data->parsed_rule_count = 0;
+    data->parsed_symbol_count = 0;
+}
+
+// 释放Makefile数据：arena中的规则、依赖、命令和变量一次性释放
+void free_makefile_data(MakefileData *data) {
+    makefile_cache_close(data->cache);
+    data->cache = NULL;
+    free_variables(data);
+    pattern_rules_free(data);
+    symbol_table_free(&data->symbols);
+    arena_free(&data->arena);
+    data->rule_of_symbol = NULL;
+    data->rule_of_symbol_capacity = 0;
+    data->rules = NULL;
+    data->rule_count = 0;
+    data->includes = NULL;
+    data->include_count = 0;
+    data->include_capacity = 0;
 }
 
 // 添加错误信息
@@ -68,168 +102,326 @@ bool file_exists(const char *filename) {
     return (stat(filename, &buffer) == 0);
 }
 
-// 检查目标是否已定义
+// 根据符号ID查找以它为目标的规则下标，不是目标返回-1
+int find_rule_index(MakefileData *data, SymbolId symbol) {
+    if ((int)symbol >= data->rule_of_symbol_capacity) {
+        return -1;
+    }
+    return data->rule_of_symbol[symbol];
+}
+
+// 检查目标是否已定义(通过驻留表查找)
 int find_target_index(MakefileData *data, const char *target) {
-    for (int i = 0; i < data->rule_count; i++) {
-        if (strcmp(data->rules[i].target, target) == 0) {
-            return i;
+    int symbol = lookup_symbol(&data->symbols, target);
+    return symbol == -1 ? -1 : find_rule_index(data, (SymbolId)symbol);
+}
+
+// 记录符号对应的规则下标，映射数组按符号数量扩容，新位置填-1
+static void set_rule_of_symbol(MakefileData *data, SymbolId symbol, int rule_idx) {
+    if ((int)symbol >= data->rule_of_symbol_capacity) {
+        int old_capacity = data->rule_of_symbol_capacity;
+        int new_capacity = old_capacity > 0 ? old_capacity : 8;
+        while (new_capacity <= (int)symbol) {
+            new_capacity *= 2;
+        }
+        data->rule_of_symbol = arena_grow(&data->arena, data->rule_of_symbol,
+                                          old_capacity * sizeof(int), new_capacity * sizeof(int));
+        for (int i = old_capacity; i < new_capacity; i++) {
+            data->rule_of_symbol[i] = -1;
         }
+        data->rule_of_symbol_capacity = new_capacity;
     }
-    return -1;
+    data->rule_of_symbol[symbol] = rule_idx;
 }
 
-//**********
+// 新增一条以target为目标的空规则并登记到符号映射(调用方保证target还没有规则)。
+// 返回的指针在下一次新增规则前有效
+Rule *add_rule(MakefileData *data, SymbolId target, int line_num) {
+    data->rules = arena_reserve(&data->arena, data->rules, &data->rule_capacity,
+                                data->rule_count, sizeof(Rule));
+    Rule *rule = &data->rules[data->rule_count];
+    rule->target = target;
+    rule->line_num = line_num;
+    rule->dependencies = NULL;
+    rule->dep_count = 0;
+    rule->commands = NULL;
+    rule->command_lines = NULL;
+    rule->cmd_count = 0;
+    rule->cmd_capacity = 0;
+    rule->oneshell = false;
+    set_rule_of_symbol(data, target, data->rule_count);
+    data->rule_count++;
+    return rule;
+}
+
+// 解析".ONESHELL:"行：没有列出目标时对所有规则生效，否则只对列出的目标生效。
+// .ONESHELL本身不作为规则(不参与构建)
+static void parse_oneshell_line(MakefileData *data, StrView line, const char *colon_pos, int line_num) {
+    StrView targets = { colon_pos + 1, line.len - (colon_pos + 1 - line.ptr) };
+    targets = view_trim(targets);
+    if (targets.len == 0) {
+        data->oneshell_all = true;
+        return;
+    }
+    if (view_find(targets, '$') != NULL) {
+        targets.ptr = expand_variable(data, targets.ptr, targets.len, &targets.len, line_num);
+    }
+    const char *end = targets.ptr + targets.len;
+    for (const char *p = targets.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        const char *name = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        data->oneshell_targets = arena_reserve(&data->arena, data->oneshell_targets,
+                                               &data->oneshell_capacity, data->oneshell_count,
+                                               sizeof(SymbolId));
+        data->oneshell_targets[data->oneshell_count++] = intern_symbol_n(&data->symbols, name, p - name);
+    }
+}
 
+// 目标是否使用单shell模式(.ONESHELL没有列出目标，或列出了该目标)
+bool oneshell_target(MakefileData *data, SymbolId target) {
+    if (data->oneshell_all) {
+        return true;
+    }
+    for (int i = 0; i < data->oneshell_count; i++) {
+        if (data->oneshell_targets[i] == target) {
+            return true;
+        }
+    }
+    return false;
+}
 
+// 解析结束后把.ONESHELL设置落到各条规则上(.ONESHELL可以出现在目标定义之前或之后)
+static void apply_oneshell(MakefileData *data) {
+    for (int i = 0; i < data->rule_count; i++) {
+        data->rules[i].oneshell = data->oneshell_all;
+    }
+    for (int i = 0; i < data->oneshell_count; i++) {
+        int rule_idx = find_rule_index(data, data->oneshell_targets[i]);
+        if (rule_idx != -1) {
+            data->rules[rule_idx].oneshell = true;
+        }
+    }
+}
 
 //**********
-// 解析目标行(如 "app: main.c utils.c")
-void parse_target_line(MakefileData *data, char *line, int line_num) {
-    char *colon_pos = strchr(line, ':');
+// 解析目标行(如 "app: main.c utils.c")。line是映射内容中的视图，
+// 目标和依赖名直接从视图驻留，只有含变量引用时才展开到临时缓冲区。
+// 目标含%时是模式规则，交给parse_pattern_line记录
+void parse_target_line(MakefileData *data, StrView line, int line_num) {
+    const char *colon_pos = view_find(line, ':');
     if (!colon_pos) return;
     
-    *colon_pos = '\0';
-    char *target = trim_whitespace(line);
-    
-    if (strlen(target) >= MAX_FILENAME_LEN) {
-        add_error(data, "Line%d: Target name too long (max %d chars)", line_num, MAX_FILENAME_LEN-1);
+    StrView target = { line.ptr, colon_pos - line.ptr };
+    target = view_trim(target);
+    data->current_pattern = -1;
+    if (target.len == strlen(ONESHELL_TARGET) && memcmp(target.ptr, ONESHELL_TARGET, target.len) == 0) {
+        parse_oneshell_line(data, line, colon_pos, line_num);
+        data->current_pattern = -2;  // .ONESHELL不是规则，随后的命令行(与make相同)被忽略，不归属上一条规则
         return;
     }
-    
-    if (find_target_index(data, target) != -1) {
-        add_error(data, "Line%d: Duplicate target '%s'", line_num, target);
+    StrView deps = { colon_pos + 1, line.len - (colon_pos + 1 - line.ptr) };
+    if (view_find(target, '%') != NULL) {
+        parse_pattern_line(data, target, deps, line_num);
         return;
     }
+    SymbolId target_symbol = intern_symbol_n(&data->symbols, target.ptr, target.len);
     
-    Rule *new_rule = &data->rules[data->rule_count];
-    strcpy(new_rule->target, target);
-    new_rule->line_num = line_num;
-    new_rule->dep_count = 0;
-    new_rule->cmd_count = 0;
+    if (find_rule_index(data, target_symbol) != -1) {
+        add_error(data, "Line%d: Duplicate target '%.*s'", line_num, (int)target.len, target.ptr);
+        return;
+    }
     
     // 改动：展开依赖列表中的变量（如 $(SRC) → main.c utils.c）
-    char *deps_raw = trim_whitespace(colon_pos + 1);
-    char deps_expanded[MAX_LINE_LENGTH] = {0};
-    expand_variable(data, deps_raw, deps_expanded, line_num);
+    deps = view_trim(deps);
+    if (view_find(deps, '$') != NULL) {
+        deps.ptr = expand_variable(data, deps.ptr, deps.len, &deps.len, line_num);
+    }
     
-    // 分割展开后的依赖项
-    char *dep_token = strtok(deps_expanded, " \t");
-    while (dep_token && new_rule->dep_count < MAX_DEPENDENCIES) {
-        char *dep_trim = trim_whitespace(dep_token);
-        if (strlen(dep_trim) == 0) {
-            dep_token = strtok(NULL, " \t");
-            continue;
-        }
-        
-        if (strlen(dep_trim) >= MAX_FILENAME_LEN) {
-            add_error(data, "Line%d: Dependency too long (max %d chars)", line_num, MAX_FILENAME_LEN-1);
-            dep_token = strtok(NULL, " \t");
-            continue;
-        }
-        
-        strcpy(new_rule->dependencies[new_rule->dep_count], dep_trim);
-        new_rule->dep_count++;
-        dep_token = strtok(NULL, " \t");
+    // 先统计依赖个数，按实际数量分配依赖数组
+    const char *end = deps.ptr + deps.len;
+    int dep_total = 0;
+    for (const char *p = deps.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        dep_total++;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+    }
+    Rule *new_rule = add_rule(data, target_symbol, line_num);
+    if (dep_total > 0) {
+        new_rule->dependencies = arena_alloc(&data->arena, dep_total * sizeof(SymbolId));
     }
     
-    data->rule_count++;
+    // 分割依赖项，每个依赖以视图形式直接驻留
+    for (const char *p = deps.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        const char *dep_start = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        new_rule->dependencies[new_rule->dep_count] =
+            intern_symbol_n(&data->symbols, dep_start, p - dep_start);
+        new_rule->dep_count++;
+    }
 }
 
 // 向当前规则添加命令
-// 改动：新增 line_num 参数用于报错，内部添加变量展开
-void add_command_to_current_rule(MakefileData *data, char *line, int line_num) {
-    if (data->rule_count == 0) return;
-    
-    Rule *current_rule = &data->rules[data->rule_count - 1];
-    if (current_rule->cmd_count >= MAX_COMMANDS) {
-        add_error(data, "Line%d: Too many commands for '%s' (max %d)", line_num, current_rule->target, MAX_COMMANDS);
+// 改动：新增 line_num 参数用于报错，内部添加变量展开；不含变量引用的命令直接从视图复制到arena。
+// 自动变量($@ $< $^)在变量展开之后按当前规则替换
+void add_command_to_current_rule(MakefileData *data, StrView line, int line_num) {
+    if (data->current_pattern != -1) {
+        add_pattern_command(data, line, line_num);
         return;
     }
+    if (data->rule_count == 0) return;
     
-    // 改动：展开命令中的变量（如 $(CC) → gcc）
-    char cmd_expanded[MAX_EXPANDED_LEN] = {0};
-    expand_variable(data, line, cmd_expanded, line_num);
+    Rule *current_rule = &data->rules[data->rule_count - 1];
+    int lines_capacity = current_rule->cmd_capacity;
+    current_rule->commands = arena_reserve(&data->arena, current_rule->commands,
+                                           &current_rule->cmd_capacity, current_rule->cmd_count,
+                                           sizeof(char *));
+    current_rule->command_lines = arena_reserve(&data->arena, current_rule->command_lines,
+                                                &lines_capacity, current_rule->cmd_count, sizeof(int));
+    current_rule->command_lines[current_rule->cmd_count] = line_num;
     
-    // 存储展开后的命令
-    strncpy(current_rule->commands[current_rule->cmd_count], cmd_expanded, MAX_LINE_LENGTH - 1);
-    current_rule->commands[current_rule->cmd_count][MAX_LINE_LENGTH - 1] = '\0'; // 防溢出
+    if (view_find(line, '$') == NULL) {
+        current_rule->commands[current_rule->cmd_count] = arena_strndup(&data->arena, line.ptr, line.len);
+    } else {
+        // 改动：展开命令中的变量（如 $(CC) → gcc）
+        size_t cmd_len;
+        const char *cmd_expanded = expand_command(data, line.ptr, line.len, &cmd_len, line_num);
+        
+        // 存储展开后的命令(按实际长度复制到arena)；仍含$时再替换自动变量
+        char *command = arena_strndup(&data->arena, cmd_expanded, cmd_len);
+        if (memchr(command, '$', cmd_len) != NULL) {
+            cmd_expanded = expand_automatic(data, command, cmd_len, current_rule, "", &cmd_len);
+            command = arena_strndup(&data->arena, cmd_expanded, cmd_len);
+        }
+        current_rule->commands[current_rule->cmd_count] = command;
+    }
     current_rule->cmd_count++;
 }
 
 
-// 检查所有依赖是否有效
-void check_dependencies(MakefileData *data) {
+// 检查本次构建所需规则的依赖是否有效(文件是否存在通过依赖图的stat缓存查询)
+void check_dependencies(MakefileData *data, DependencyGraph *graph) {
     for (int i = 0; i < data->rule_count; i++) {
         Rule *rule = &data->rules[i];
+        if (!node_needed(graph, rule->target) || find_rule_index(data, rule->target) != i) {
+            continue;  // 不需要构建，或是已被模式规则补全后的新规则代替的显式规则
+        }
         
         for (int j = 0; j < rule->dep_count; j++) {
-            char *dep = rule->dependencies[j];
+            SymbolId dep = rule->dependencies[j];
             bool is_valid = false;
             
             // 检查是否是已定义的目标
-            if (find_target_index(data, dep) != -1) {
+            if (find_rule_index(data, dep) != -1) {
                 is_valid = true;
             }
-            // 检查是否是存在的文件
-            else if (file_exists(dep)) {
+            // 检查是否是存在的文件(符号ID即图中的节点下标)
+            else if (stat_node(graph, dep)->exists) {
                 is_valid = true;
             }
             
             // 无效依赖
             if (!is_valid) {
                 add_error(data, "Line%d: Invalid dependency '%s'", 
-                         rule->line_num, dep);
+                         rule->line_num, symbol_name(&data->symbols, dep));
             }
         }
     }
 }
 
-// 解析Makefile并进行检查
-int parse_and_check_makefile(const char *filename, MakefileData *data) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("无法打开文件");
+// 解析一行已清理的内容：变量定义、目标行或命令行
+static void parse_line(MakefileData *data, StrView line, int line_num) {
+    bool is_command = (line.ptr[0] == '\t'); // 用行首Tab判断命令行
+    StrView trimmed_line = view_trim(line);
+
+    // 规则之后的命令行可以含'='和':'，不能当作变量或目标解析
+    if (is_command && (data->rule_count > 0 || data->current_pattern != -1)) {
+        add_command_to_current_rule(data, trimmed_line, line_num);
+        return;
+    }
+
+    // 改动1：优先解析变量行（如 CC = gcc）
+    if (parse_variable_definition(data, trimmed_line, line_num)) {
+        return; // 是变量行，跳过后续判断
+    }
+
+    // include指令：记录depfile列表，建依赖图时再读取
+    StrView include_files;
+    bool include_optional;
+    if (!is_command && view_split_include(trimmed_line, &include_files, &include_optional)) {
+        add_depfile_include(data, include_files, include_optional, line_num);
+        return;
+    }
+
+    // 2. 原有逻辑：解析目标行/命令行
+    if (view_find(trimmed_line, ':') != NULL) {
+        parse_target_line(data, trimmed_line, line_num);
+    } else if (is_command) {
+        // 改动2：调用修改后的命令添加函数（传 line_num）
+        add_command_to_current_rule(data, trimmed_line, line_num);
+    } else {
+        // 改动3：新增无效行报错（既不是变量/目标/命令）
+        add_error(data, "Line%d: Invalid line (not variable/target/command)", line_num);
+    }
+}
+
+// 解析Makefile并进行检查：单遍流式处理，每行依次完成注释清理、语法检查和规则/变量构建。
+// 文件通过mmap映射，每行以视图形式处理，行长度不受限制，解析过程不做逐行分配。
+// cleaned_out非空时同时把清理后的内容写入该文件(调试输出，不再回读)。
+// 返回0表示成功，PARSE_SYNTAX_ERROR表示存在语法错误，1表示解析错误
+int parse_and_check_makefile(const char *filename, MakefileData *data, FILE *cleaned_out) {
+    MakefileReader reader;
+    if (reader_open(&reader, filename) != 0) {
         return 1;
     }
 
-    char line[MAX_LINE_LENGTH];
-    int line_num = 0;
+    printf("正在处理Makefile...\n\n");
 
-    while (fgets(line, MAX_LINE_LENGTH, file)) {
-        line_num++;
-        char processed_line[MAX_LINE_LENGTH];
-        strcpy(processed_line, line);
+    StrView line;
+    bool rule_defined = false;  // 语法检查的跨行状态：是否已出现过合法的目标行
+    int syntax_errors = 0;
 
-        // 1. 处理注释和换行符（原有逻辑）
-        char *comment_pos = strchr(processed_line, '#');
-        if (comment_pos) *comment_pos = '\0';
-        size_t len = strlen(processed_line);
-        if (len > 0 && processed_line[len - 1] == '\n') processed_line[len - 1] = '\0';
-        char *trimmed_line = trim_whitespace(processed_line);
-        if (strlen(trimmed_line) == 0) continue; // 跳过空白行
+    while (reader_next_line(&reader, &line)) {
+        int line_num = reader.line_num;
 
-        // 改动1：优先解析变量行（如 CC = gcc）
-        if (parse_variable_definition(data, trimmed_line, line_num)) {
-            continue; // 是变量行，跳过后续判断
+        // 1. 去除注释和行尾空白，跳过空白行
+        if (clean_makefile_line(&line)) {
+            continue;
+        }
+        printf("处理后: %.*s\n", (int)line.len, line.ptr);
+        if (cleaned_out != NULL) {
+            fwrite(line.ptr, 1, line.len, cleaned_out);
+            fputc('\n', cleaned_out);
         }
 
-        // 2. 原有逻辑：解析目标行/命令行
-        if (strchr(trimmed_line, ':') != NULL) {
-            parse_target_line(data, trimmed_line, line_num);
-        } else if (line[0] == '\t') { // 用原始行判断Tab缩进
-            char *cmd_raw = trim_whitespace(processed_line + 1);
-            if (strlen(cmd_raw) > 0) {
-                // 改动2：调用修改后的命令添加函数（传 line_num）
-                add_command_to_current_rule(data, cmd_raw, line_num);
-            }
-        } else {
-            // 改动3：新增无效行报错（既不是变量/目标/命令）
-            add_error(data, "Line%d: Invalid line (not variable/target/command)", line_num);
+        // 2. 静态语法检查；有语法错误的行不再解析
+        int line_errors = check_line_syntax(line, line_num, &rule_defined);
+        if (line_errors > 0) {
+            syntax_errors += line_errors;
+            continue;
         }
+
+        // 3. 构建变量/规则
+        parse_line(data, line, line_num);
+    }
+
+    reader_close(&reader);
+    apply_oneshell(data);
+    data->parsed_rule_count = data->rule_count;
+    data->parsed_symbol_count = data->symbols.count;
+    printf("\nMakefile处理完成\n");
+
+    if (syntax_errors > 0) {
+        printf("Found %d syntax error(s) in Makefile.\n", syntax_errors);
+        return PARSE_SYNTAX_ERROR;
     }
+    printf("Makefile syntax check passed. No errors found.\n");
 
-    fclose(file);
-    check_dependencies(data);
+    // 依赖有效性检查在构建依赖图之后进行(见check_dependencies)，以共用stat缓存
     
     // 输出错误（原有逻辑）
     for (int i = 0; i < data->error_count; i++) {
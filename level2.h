@@ -41,16 +41,24 @@ typedef struct {
 // 存储所有规则和错误信息的全局结构（原有结构扩展）
 
 
+#define PARSE_SYNTAX_ERROR 2  // parse_and_check_makefile的返回值：存在语法错误
+#define ONESHELL_TARGET ".ONESHELL"  // 特殊目标：规则的全部命令在同一个shell中执行
+
 int execute_target(MakefileData *data, const char *target_name);
 void init_makefile_data(MakefileData *data);
+void free_makefile_data(MakefileData *data);
 void add_error(MakefileData *data, const char *format, ...);
 bool file_exists(const char *filename);
 int find_target_index(MakefileData *data, const char *target);
+int find_rule_index(MakefileData *data, SymbolId symbol);
+Rule *add_rule(MakefileData *data, SymbolId target, int line_num);
+bool oneshell_target(MakefileData *data, SymbolId target);
 //*****
-void parse_target_line(MakefileData *data, char *line, int line_num);
-void add_command_to_current_rule(MakefileData *data, char *line, int line_num);
-void check_dependencies(MakefileData *data);
-int parse_and_check_makefile(const char *filename, MakefileData *data);
+void parse_target_line(MakefileData *data, StrView line, int line_num);
+void add_command_to_current_rule(MakefileData *data, StrView line, int line_num);
+struct DependencyGraph;
+void check_dependencies(MakefileData *data, struct DependencyGraph *graph);
+int parse_and_check_makefile(const char *filename, MakefileData *data, FILE *cleaned_out);
 
 
 
@@ -4,20 +4,30 @@
 #include <sys/stat.h>  // 用于文件状态检查
 #include <time.h>      // 用于时间戳处理
 #include "level3.h"
+#include "depfile.h"
+#include "pattern_rules.h"
 
-// 创建队列
-Queue* create_queue() {
+// 创建队列(Kahn算法中每个节点最多入队一次，容量取节点数即可)
+Queue* create_queue(int capacity) {
     Queue* q = (Queue*)malloc(sizeof(Queue));
+    q->capacity = capacity > 0 ? capacity : 1;
+    q->items = (int*)malloc(q->capacity * sizeof(int));
     q->front = 0;
     q->rear = -1;
     q->size = 0;
     return q;
 }
 
+// 释放队列
+void free_queue(Queue* q) {
+    free(q->items);
+    free(q);
+}
+
 // 入队操作
 void enqueue(Queue* q, int value) {
-    if (q->size < MAX_NODES) {
-        q->rear = (q->rear + 1) % MAX_NODES;
+    if (q->size < q->capacity) {
+        q->rear = (q->rear + 1) % q->capacity;
         q->items[q->rear] = value;
         q->size++;
     }
@@ -27,7 +37,7 @@ void enqueue(Queue* q, int value) {
 int dequeue(Queue* q) {
     if (q->size > 0) {
         int value = q->items[q->front];
-        q->front = (q->front + 1) % MAX_NODES;
+        q->front = (q->front + 1) % q->capacity;
         q->size--;
         return value;
     }
@@ -39,79 +49,264 @@ int is_empty(Queue* q) {
     return q->size == 0;
 }
 
-// 查找节点在图中的索引
-int find_node_index(DependencyGraph* graph, const char* name) {
-    for (int i = 0; i < graph->node_count; i++) {
-        if (strcmp(graph->nodes[i], name) == 0) {
-            return i;
+// 创建优先队列(同样每个节点最多入队一次)
+PriorityQueue* create_priority_queue(int capacity) {
+    PriorityQueue* q = (PriorityQueue*)malloc(sizeof(PriorityQueue));
+    q->capacity = capacity > 0 ? capacity : 1;
+    q->items = (ReadyItem*)malloc(q->capacity * sizeof(ReadyItem));
+    q->size = 0;
+    q->next_seq = 0;
+    return q;
+}
+
+void free_priority_queue(PriorityQueue* q) {
+    free(q->items);
+    free(q);
+}
+
+// a是否应先于b出队
+static int ready_before(const ReadyItem* a, const ReadyItem* b) {
+    return a->priority > b->priority || (a->priority == b->priority && a->seq < b->seq);
+}
+
+// 入队：放在堆尾后上浮
+void priority_push(PriorityQueue* q, int node, double priority) {
+    if (q->size >= q->capacity) {
+        return;
+    }
+    ReadyItem item = { node, priority, q->next_seq++ };
+    int i = q->size++;
+    while (i > 0 && ready_before(&item, &q->items[(i - 1) / 2])) {
+        q->items[i] = q->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->items[i] = item;
+}
+
+// 出队：取堆顶，堆尾元素下沉填补
+int priority_pop(PriorityQueue* q) {
+    if (q->size == 0) {
+        return -1;
+    }
+    int node = q->items[0].node;
+    ReadyItem last = q->items[--q->size];
+    int i = 0;
+    while (2 * i + 1 < q->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < q->size && ready_before(&q->items[child + 1], &q->items[child])) {
+            child++;
+        }
+        if (!ready_before(&q->items[child], &last)) {
+            break;
         }
+        q->items[i] = q->items[child];
+        i = child;
     }
-    return -1;
+    q->items[i] = last;
+    return node;
+}
+
+int priority_is_empty(PriorityQueue* q) {
+    return q->size == 0;
 }
 
-// 向图中添加节点(去重)
-void add_node(DependencyGraph* graph, const char* name) {
-    if (find_node_index(graph, name) == -1 && graph->node_count < MAX_NODES) {
-        graph->nodes[graph->node_count] = (char*)malloc(MAX_FILENAME_LEN);
-        strcpy(graph->nodes[graph->node_count], name);
-        graph->node_count++;
+// 查找节点在图中的索引(节点下标即符号ID)。图建好之后才驻留的符号(如守护进程收到的
+// 新目标名)不是图中的节点，返回-1
+int find_node_index(DependencyGraph* graph, const char* name) {
+    int symbol = lookup_symbol(graph->symbols, name);
+    return symbol < graph->node_count ? symbol : -1;
+}
+
+// 取节点对应的文件名
+const char* node_name(DependencyGraph* graph, int node_idx) {
+    return symbol_name(graph->symbols, (SymbolId)node_idx);
+}
+
+// 按规则和depfile依赖边填充CSR数组(偏移数组已清零)：先统计每个节点的出度/入度，
+// 再前缀和得到偏移，最后填充边数组
+static void fill_edges(MakefileData* data, DependencyGraph* graph, const DepfileEdges* depfile_edges) {
+    int n = graph->node_count;
+    graph->edge_count = 0;
+
+    // 1. 统计度数: 每个依赖产生一条边 依赖 -> 目标。
+    // 没有命令、由模式规则补全的显式规则已被其后的新规则代替，不再产生边
+    for (int i = 0; i < data->rule_count; i++) {
+        Rule* rule = &data->rules[i];
+        if (find_rule_index(data, rule->target) != i) {
+            continue;
+        }
+        for (int j = 0; j < rule->dep_count; j++) {
+            graph->out_offset[rule->dependencies[j] + 1]++;
+            graph->in_offset[rule->target + 1]++;
+        }
+        graph->edge_count += rule->dep_count;
+    }
+    for (int i = 0; i < depfile_edges->count; i++) {
+        graph->out_offset[depfile_edges->edges[i].dep + 1]++;
+        graph->in_offset[depfile_edges->edges[i].target + 1]++;
+    }
+    graph->edge_count += depfile_edges->count;
+    for (int u = 0; u < n; u++) {
+        graph->in_degree[u] = graph->in_offset[u + 1];
+        graph->out_offset[u + 1] += graph->out_offset[u];
+        graph->in_offset[u + 1] += graph->in_offset[u];
+    }
+
+    // 2. 填充正向/反向边数组
+    int edges = graph->edge_count > 0 ? graph->edge_count : 1;
+    graph->out_edges = (int*)malloc(edges * sizeof(int));
+    graph->in_edges = (int*)malloc(edges * sizeof(int));
+    // 每个目标的反向边中规则列出的依赖在前，depfile中的依赖在后
+    int* out_fill = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    int* in_fill = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    memcpy(out_fill, graph->out_offset, n * sizeof(int));
+    memcpy(in_fill, graph->in_offset, n * sizeof(int));
+    for (int i = 0; i < data->rule_count; i++) {
+        Rule* rule = &data->rules[i];
+        if (find_rule_index(data, rule->target) != i) {
+            continue;
+        }
+        for (int j = 0; j < rule->dep_count; j++) {
+            int dep_idx = rule->dependencies[j];
+            graph->out_edges[out_fill[dep_idx]++] = rule->target;
+            graph->in_edges[in_fill[rule->target]++] = dep_idx;
+        }
     }
+    for (int i = 0; i < depfile_edges->count; i++) {
+        const DepfileEdge* edge = &depfile_edges->edges[i];
+        graph->out_edges[out_fill[edge->dep]++] = edge->target;
+        graph->in_edges[in_fill[edge->target]++] = edge->dep;
+    }
+    free(out_fill);
+    free(in_fill);
 }
 
-// 构建依赖图
+// 构建依赖图(CSR)。include列出的必需depfile无法读取时返回NULL
 DependencyGraph* build_dependency_graph(MakefileData* data) {
     DependencyGraph* graph = (DependencyGraph*)malloc(sizeof(DependencyGraph));
     memset(graph, 0, sizeof(DependencyGraph));
 
-    // 1. 收集所有节点(目标和依赖)
-    // 收集目标节点
-    for (int i = 0; i < data->rule_count; i++) {
-        add_node(graph, data->rules[i].target);
+    // depfile中的依赖先驻留为符号，使头文件也成为图中的节点。
+    // 必需的depfile读不出时头文件依赖不完整，不能据此判断目标是否最新
+    DepfileEdges depfile_edges;
+    int errors_before = data->error_count;
+    if (depfile_collect(data, DEPFILE_LOG_FILE, &depfile_edges) != 0) {
+        for (int i = errors_before; i < data->error_count; i++) {
+            printf("Error: %s\n", data->errors[i]);
+        }
+        printf("无法读取依赖文件，无法继续执行\n");
+        depfile_edges_free(&depfile_edges);
+        free(graph);
+        return NULL;
     }
 
-    // 收集依赖节点
-    for (int i = 0; i < data->rule_count; i++) {
-        for (int j = 0; j < data->rules[i].dep_count; j++) {
-            add_node(graph, data->rules[i].dependencies[j]);
-        }
+    // 所有节点(目标和依赖)就是驻留表中的全部符号
+    int n = data->symbols.count;
+    graph->symbols = &data->symbols;
+    graph->node_count = n;
+    graph->out_offset = (int*)calloc(n + 1, sizeof(int));
+    graph->in_offset = (int*)calloc(n + 1, sizeof(int));
+    graph->in_degree = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    graph->stat_cache = (StatEntry*)calloc(n > 0 ? n : 1, sizeof(StatEntry));
+
+    // 规则取自Makefile缓存时，边数组直接从缓存复制
+    if (!makefile_cache_fill_graph(data->cache, graph)) {
+        fill_edges(data, graph, &depfile_edges);
     }
+    depfile_edges_free(&depfile_edges);
+    return graph;
+}
 
-    // 2. 构建邻接表和入度
-    for (int i = 0; i < data->rule_count; i++) {
-        Rule* rule = &data->rules[i];
-        int target_idx = find_node_index(graph, rule->target);
-        
-        if (target_idx == -1) continue;
+// 把按节点索引的数组从old_count项扩展到new_count项，新增部分清零
+static void* grow_node_array(void* array, int old_count, int new_count, size_t elem_size) {
+    array = realloc(array, (new_count > 0 ? new_count : 1) * elem_size);
+    memset((char*)array + old_count * elem_size, 0, (new_count - old_count) * elem_size);
+    return array;
+}
 
-        // 为每个依赖添加边: 依赖 -> 目标
-        for (int j = 0; j < rule->dep_count; j++) {
-            int dep_idx = find_node_index(graph, rule->dependencies[j]);
-            
-            if (dep_idx == -1) continue;
+// 构建后重新读取depfile(只有大小或mtime变化的文件重新解析)：有变化时按新的依赖边重建CSR数组和
+// 拓扑顺序，新出现的头文件成为新节点，构建目标的依赖闭包随之扩展。节点下标不变，
+// 已有节点的stat缓存和构建记录保留。返回依赖边是否有变化
+int refresh_depfile_edges(MakefileData* data, DependencyGraph* graph, int** topo_order, int* order_size) {
+    if (data->include_count == 0) {
+        return 0;
+    }
+    DepfileEdges depfile_edges;
+    int errors_before = data->error_count;
+    if (depfile_collect(data, DEPFILE_LOG_FILE, &depfile_edges) != 0) {
+        for (int i = errors_before; i < data->error_count; i++) {
+            printf("警告: %s\n", data->errors[i]);
+        }
+        printf("警告: 重新读取depfile失败，保留原有的依赖边\n");
+        data->error_count = errors_before;
+        depfile_edges_free(&depfile_edges);
+        return 0;
+    }
+    if (!depfile_edges.changed) {
+        depfile_edges_free(&depfile_edges);
+        return 0;
+    }
 
-            // 添加邻接关系
-            if (graph->adj_size[dep_idx] < MAX_ADJACENCY) {
-                graph->adjacency[dep_idx][graph->adj_size[dep_idx]] = target_idx;
-                graph->adj_size[dep_idx]++;
-                graph->in_degree[target_idx]++;
+    int old_count = graph->node_count;
+    int n = data->symbols.count;
+    graph->node_count = n;
+    graph->stat_cache = (StatEntry*)grow_node_array(graph->stat_cache, old_count, n, sizeof(StatEntry));
+    graph->in_degree = (int*)grow_node_array(graph->in_degree, old_count, n, sizeof(int));
+    if (graph->needed != NULL) {
+        graph->needed = (unsigned char*)grow_node_array(graph->needed, old_count, n, 1);
+    }
+    if (graph->build_db != NULL) {
+        build_db_resize(graph->build_db, n);
+    }
+    if (graph->history != NULL) {
+        build_history_resize(graph->history, n);
+    }
+    free(graph->out_edges);
+    free(graph->in_edges);
+    graph->out_offset = (int*)realloc(graph->out_offset, (n + 1) * sizeof(int));
+    graph->in_offset = (int*)realloc(graph->in_offset, (n + 1) * sizeof(int));
+    memset(graph->out_offset, 0, (n + 1) * sizeof(int));
+    memset(graph->in_offset, 0, (n + 1) * sizeof(int));
+    fill_edges(data, graph, &depfile_edges);
+    depfile_edges_free(&depfile_edges);
+
+    // 依赖闭包中的目标新增的依赖(头文件)同样属于闭包
+    if (graph->needed != NULL) {
+        int* stack = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+        int top = 0;
+        for (int u = 0; u < n; u++) {
+            if (graph->needed[u]) {
+                stack[top++] = u;
             }
         }
+        while (top > 0) {
+            int u = stack[--top];
+            for (int e = graph->in_offset[u]; e < graph->in_offset[u + 1]; e++) {
+                int dep = graph->in_edges[e];
+                if (!graph->needed[dep]) {
+                    graph->needed[dep] = 1;
+                    stack[top++] = dep;
+                }
+            }
+        }
+        free(stack);
     }
 
-    return graph;
+    free(*topo_order);
+    *topo_order = topological_sort(graph, order_size);
+    return 1;
 }
 
 // 打印依赖关系图
 void print_dependency_graph(DependencyGraph* graph) {
     printf("===== 依赖关系图 =====\n");
     for (int i = 0; i < graph->node_count; i++) {
-        printf("节点: %s\n", graph->nodes[i]);
+        printf("节点: %s\n", node_name(graph, i));
         printf("  入度: %d\n", graph->in_degree[i]);
         printf("  依赖它的节点: ");
         
-        for (int j = 0; j < graph->adj_size[i]; j++) {
-            int adj_idx = graph->adjacency[i][j];
-            printf("%s ", graph->nodes[adj_idx]);
+        for (int e = graph->out_offset[i]; e < graph->out_offset[i + 1]; e++) {
+            printf("%s ", node_name(graph, graph->out_edges[e]));
         }
         printf("\n\n");
     }
@@ -123,7 +318,7 @@ int* topological_sort(DependencyGraph* graph, int* order_size) {
     int* in_degree_copy = (int*)malloc(graph->node_count * sizeof(int));
     memcpy(in_degree_copy, graph->in_degree, graph->node_count * sizeof(int));
 
-    Queue* q = create_queue();
+    Queue* q = create_queue(graph->node_count);
     int* result = (int*)malloc(graph->node_count * sizeof(int));
     *order_size = 0;
 
@@ -139,9 +334,9 @@ int* topological_sort(DependencyGraph* graph, int* order_size) {
         int u = dequeue(q);
         result[(*order_size)++] = u;
 
-        // 处理所有邻接节点
-        for (int i = 0; i < graph->adj_size[u]; i++) {
-            int v = graph->adjacency[u][i];
+        // 处理所有邻接节点(连续存放的正向边)
+        for (int e = graph->out_offset[u]; e < graph->out_offset[u + 1]; e++) {
+            int v = graph->out_edges[e];
             in_degree_copy[v]--;
             
             if (in_degree_copy[v] == 0) {
@@ -151,235 +346,760 @@ int* topological_sort(DependencyGraph* graph, int* order_size) {
     }
 
     free(in_degree_copy);
-    free(q);
+    free_queue(q);
     return result;
 }
 
-// 释放依赖图内存
+// 释放依赖图内存(节点名称属于驻留表，不在此释放)
 void free_graph(DependencyGraph* graph) {
-    for (int i = 0; i < graph->node_count; i++) {
-        free(graph->nodes[i]);
-    }
+    free(graph->out_offset);
+    free(graph->out_edges);
+    free(graph->in_offset);
+    free(graph->in_edges);
+    free(graph->in_degree);
+    free(graph->stat_cache);
+    free(graph->needed);
     free(graph);
 }
 
-// 辅助函数：判断名称是否为目标(存在对应的规则)
-int is_target(MakefileData* data, const char* name) {
-    for (int i = 0; i < data->rule_count; i++) {
-        if (strcmp(data->rules[i].target, name) == 0) {
-            return 1; // 是目标
+// 节点是否在本次构建目标的依赖闭包中
+int node_needed(const DependencyGraph* graph, int node_idx) {
+    return graph->needed == NULL || graph->needed[node_idx];
+}
+
+// 默认目标：Makefile中第一个不以'.'开头的规则(与GNU make相同，.PHONY等特殊目标和
+// 由模式规则实例化的规则不算)
+int default_goal(MakefileData* data) {
+    for (int i = 0; i < data->parsed_rule_count; i++) {
+        if (symbol_name(&data->symbols, data->rules[i].target)[0] != '.') {
+            return (int)data->rules[i].target;
         }
     }
-    return 0; // 不是目标
+    return -1;
 }
 
+// 确定本次构建的目标(未指定时取默认目标)，并沿反向边(目标 -> 依赖)求出它们的
+// 传递依赖闭包，记在graph->needed中。之后的stat检查和命令执行只涉及闭包内的节点。
+// 有目标既没有规则也不是已存在的文件时返回1
+int select_goals(MakefileData* data, DependencyGraph* graph, const char** goals, int goal_count) {
+    int* stack = (int*)malloc((graph->node_count > 0 ? graph->node_count : 1) * sizeof(int));
+    int top = 0;
+    graph->needed = (unsigned char*)calloc(graph->node_count > 0 ? graph->node_count : 1, 1);
 
-// 辅助函数：获取文件修改时间戳
-time_t get_file_mtime(const char* filename) {
+    int status = 0;
+    if (goal_count == 0) {
+        int goal = default_goal(data);
+        if (goal != -1) {
+            printf("默认构建目标: %s\n", node_name(graph, goal));
+            graph->needed[goal] = 1;
+            stack[top++] = goal;
+        }
+    }
+    for (int i = 0; i < goal_count; i++) {
+        int goal = find_node_index(graph, goals[i]);
+        if (goal == -1 && file_exists(goals[i])) {
+            continue;  // 不在常驻依赖图中的已存在文件(守护进程收到的新名称)，无需构建
+        }
+        if (goal == -1 || (find_rule_by_symbol(data, goal) == NULL && !stat_node(graph, goal)->exists)) {
+            add_error(data, "错误: 没有规则可以构建目标 '%s'", goals[i]);
+            status = 1;
+            continue;
+        }
+        if (!graph->needed[goal]) {
+            graph->needed[goal] = 1;
+            stack[top++] = goal;
+        }
+    }
+
+    // 每个节点最多入栈一次
+    while (top > 0) {
+        int u = stack[--top];
+        for (int e = graph->in_offset[u]; e < graph->in_offset[u + 1]; e++) {
+            int dep = graph->in_edges[e];
+            if (!graph->needed[dep]) {
+                graph->needed[dep] = 1;
+                stack[top++] = dep;
+            }
+        }
+    }
+    free(stack);
+    return status;
+}
+
+
+// 通过缓存获取节点对应文件的状态：每轮构建中每个路径最多stat一次，
+// 直到生成它的命令执行后被invalidate_stat清除
+const StatEntry* stat_node(DependencyGraph* graph, int node_idx) {
+    StatEntry* entry = &graph->stat_cache[node_idx];
+    if (entry->valid) {
+        graph->stat_hits++;
+    } else {
+        graph->stat_calls++;
+        stat_entry_load(entry, node_name(graph, node_idx));
+    }
+    return entry;
+}
+
+// 对path调用stat并填写缓存项(建图之前的模式规则查找也用它缓存文件状态)
+void stat_entry_load(StatEntry* entry, const char* path) {
     struct stat buffer;
-    if (stat(filename, &buffer) == 0) {
-        return buffer.st_mtime; // 返回修改时间
+    entry->valid = 1;
+    entry->exists = (stat(path, &buffer) == 0);
+    if (entry->exists) {
+        entry->mtime = buffer.st_mtim;
+        entry->size = buffer.st_size;
+    } else {
+        entry->mtime.tv_sec = 0;
+        entry->mtime.tv_nsec = 0;
+        entry->size = 0;
     }
-    return -1; // 文件不存在
 }
 
-// 辅助函数：根据目标名称查找规则
-Rule* find_rule_by_target(MakefileData* data, const char* target) {
-    for (int i = 0; i < data->rule_count; i++) {
-        if (strcmp(data->rules[i].target, target) == 0) {
-            return &data->rules[i];
+// 使节点的stat缓存失效(在可能生成该文件的命令执行之后调用)
+void invalidate_stat(DependencyGraph* graph, int node_idx) {
+    graph->stat_cache[node_idx].valid = 0;
+}
+
+// 比较两个纳秒精度的时间戳：a比b新返回1
+int mtime_newer(const struct timespec* a, const struct timespec* b) {
+    if (a->tv_sec != b->tv_sec) {
+        return a->tv_sec > b->tv_sec;
+    }
+    return a->tv_nsec > b->tv_nsec;
+}
+
+// 判断依赖是否使目标过期：依赖比目标新(或本轮刚被重新构建)时，
+// 若构建数据库记录的依赖内容哈希与当前一致，则视为未变化(例如git checkout后只改了mtime)
+int dep_changed(DependencyGraph* graph, int target_idx, int dep_idx, int dep_rebuilt) {
+    const StatEntry* target_stat = stat_node(graph, target_idx);
+    const StatEntry* dep_stat = stat_node(graph, dep_idx);
+    if (!dep_rebuilt && !(dep_stat->exists && mtime_newer(&dep_stat->mtime, &target_stat->mtime))) {
+        return 0;
+    }
+    if (graph->build_db != NULL && build_db_dep_unchanged(graph->build_db, graph, target_idx, dep_idx)) {
+        return 0;
+    }
+    return 1;
+}
+
+// 判断目标展开后的命令是否与上次成功构建时不同(例如修改了CFLAGS)
+int commands_changed(DependencyGraph* graph, Rule* rule, int target_idx) {
+    if (graph->build_db == NULL) {
+        return 0;
+    }
+    return build_db_commands_changed(graph->build_db, target_idx,
+                                     hash_commands(rule->commands, rule->cmd_count));
+}
+
+// 规则成功执行后，把目标的依赖哈希和命令签名写入构建数据库
+static void remember_build(DependencyGraph* graph, Rule* rule, int target_idx) {
+    if (graph->build_db != NULL) {
+        build_db_record(graph->build_db, graph, target_idx,
+                        hash_commands(rule->commands, rule->cmd_count));
+    }
+}
+
+// 单调时钟的当前时间(秒)，用于统计目标构建耗时
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// 记录目标本次成功构建的墙钟耗时，供之后的并行构建估计关键路径
+static void remember_duration(DependencyGraph* graph, int target_idx, double seconds) {
+    if (graph->history != NULL) {
+        build_history_record(graph->history, target_idx, seconds);
+    }
+}
+
+// 已是最新但尚无记录的目标(例如首次使用数据库)记下当前状态作为基准，
+// 之后修改命令才能被发现
+static void remember_up_to_date(DependencyGraph* graph, Rule* rule, int target_idx) {
+    if (graph->build_db != NULL && !graph->build_db->targets[target_idx].recorded
+        && stat_node(graph, target_idx)->exists) {
+        remember_build(graph, rule, target_idx);
+    }
+}
+
+// 串行执行规则的命令，全部成功返回1，某条命令失败时立即停止并返回0。
+// .ONESHELL规则把命令列表作为一个脚本交给同一个shell，失败的行由脚本自己报告
+static int run_rule_commands(Rule* rule, const char* name) {
+    struct rusage usage = {0};
+    if (rule->oneshell && rule->cmd_count > 0) {
+        for (int j = 0; j < rule->cmd_count; j++) {
+            printf("    执行命令: %s\n", rule->commands[j]);
+        }
+        char* script = oneshell_script(rule->commands, rule->command_lines, rule->cmd_count);
+        double start = trace_now();
+        int status = my_system_usage(script, &usage);
+        trace_command(name, rule->commands[0], rule->line_num, 1, start, &usage, status);
+        free(script);
+        return status == 0;
+    }
+    for (int j = 0; j < rule->cmd_count; j++) {
+        printf("    执行命令: %s\n", rule->commands[j]);
+        double start = trace_now();
+        int status = my_system_usage(rule->commands[j], &usage); // 实际执行命令
+        trace_command(name, rule->commands[j], rule->command_lines[j], 1, start, &usage, status);
+        if (status != 0) {
+            return 0;
         }
     }
-    return NULL;
+    return 1;
 }
 
-// 辅助函数：递归检查并构建依赖
-void build_dependency(MakefileData* data, DependencyGraph* graph, 
-                            int* topo_order, int order_size, const char* dep_name) {
-    // 如果依赖不是目标，不需要构建
-    if (!is_target(data, dep_name)) {
-        return;
+// 并行构建中启动规则从第first条开始的命令；.ONESHELL规则一次启动全部命令。
+// 通过last返回这次启动覆盖到的最后一条命令下标
+static pid_t start_rule_commands(Rule* rule, const char* name, int slot, int first, int* last,
+                                 double* start) {
+    *start = trace_now();
+    if (rule->oneshell) {
+        for (int j = first; j < rule->cmd_count; j++) {
+            printf("[%d] 构建 %s: %s\n", slot + 1, name, rule->commands[j]);
+        }
+        char* script = oneshell_script(rule->commands + first, rule->command_lines + first,
+                                       rule->cmd_count - first);
+        pid_t pid = my_system_start(script);
+        free(script);
+        *last = rule->cmd_count - 1;
+        return pid;
     }
+    printf("[%d] 构建 %s: %s\n", slot + 1, name, rule->commands[first]);
+    *last = first;
+    return my_system_start(rule->commands[first]);
+}
 
-    // 找到依赖在拓扑排序中的位置并处理
-    for (int i = 0; i < order_size; i++) {
-        int node_idx = topo_order[i];
-        const char* node_name = graph->nodes[node_idx];
-        
-        if (strcmp(node_name, dep_name) == 0) {
-            Rule* rule = find_rule_by_target(data, node_name);
-            if (!rule) return;
-
-            // 检查依赖目标是否需要构建
-            int target_exists = file_exists(node_name);
-            time_t target_mtime = target_exists ? get_file_mtime(node_name) : 0;
-            int need_rebuild = !target_exists;
-
-            // 检查依赖的依赖是否需要构建（递归）
-            if (!need_rebuild) {
-                for (int j = 0; j < rule->dep_count; j++) {
-                    const char* sub_dep = rule->dependencies[j];
-                    // 先递归处理子依赖
-                    build_dependency(data, graph, topo_order, order_size, sub_dep);
-                    
-                    // 检查子依赖是否更新
-                    if (file_exists(sub_dep) && get_file_mtime(sub_dep) > target_mtime) {
-                        need_rebuild = 1;
-                        break;
-                    }
-                }
-            }
+// 计算两个时间戳之差(秒)，用于打印
+static double mtime_diff(const struct timespec* a, const struct timespec* b) {
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
 
-            // 构建依赖目标
-            if (need_rebuild) {
-                printf("\n递归构建依赖目标: %s\n", node_name);
-                
-                // 检查所有子依赖是否存在
-                int all_sub_deps_exist = 1;
-                for (int j = 0; j < rule->dep_count; j++) {
-                    const char* sub_dep = rule->dependencies[j];
-                    if (!file_exists(sub_dep)) {
-                        if (data->error_count < 100) {
-                            sprintf(data->errors[data->error_count], 
-                                    "错误: 依赖目标 %s 的依赖 %s 不存在 (行号: %d)",
-                                    node_name, sub_dep, rule->line_num);
-                            data->error_count++;
-                        }
-                        printf("  错误: 子依赖 %s 不存在\n", sub_dep);
-                        all_sub_deps_exist = 0;
-                    }
-                }
+// 辅助函数：根据符号ID(即节点下标)查找规则
+Rule* find_rule_by_symbol(MakefileData* data, SymbolId symbol) {
+    int idx = find_rule_index(data, symbol);
+    return idx != -1 ? &data->rules[idx] : NULL;
+}
 
-                // 执行构建命令
-                if (all_sub_deps_exist) {
-                    for (int j = 0; j < rule->cmd_count; j++) {
-                        printf("    执行命令: %s\n", rule->commands[j]);
-                        // 实际执行命令
-                        my_system(rule->commands[j]);
-                    }
-                }
-            }
-            return;
+// 判断目标是否需要重新构建：目标不存在、命令签名改变、或依赖(内容)比目标新。
+// 依赖本轮已重新构建时视为已变化。因依赖变化而需要构建时通过changed_dep返回该依赖，否则为-1
+static int need_rebuild_target(DependencyGraph* graph, Rule* rule, int node_idx,
+                               const NodeState* state, int* changed_dep) {
+    *changed_dep = -1;
+    const StatEntry* target_stat = stat_node(graph, node_idx);
+    if (!target_stat->exists || commands_changed(graph, rule, node_idx)) {
+        return 1;
+    }
+    int first = graph->in_offset[node_idx];
+    for (int e = first; e < graph->in_offset[node_idx + 1]; e++) {
+        int dep_idx = graph->in_edges[e];
+        // depfile记录的依赖排在规则依赖之后，已不存在(如删除了头文件)时按已变化处理
+        if (e - first >= rule->dep_count && !stat_node(graph, dep_idx)->exists
+            && state[dep_idx] != NODE_BUILT) {
+            *changed_dep = dep_idx;
+            return 1;
+        }
+        if (dep_changed(graph, node_idx, dep_idx, state[dep_idx] == NODE_BUILT)) {
+            *changed_dep = dep_idx;
+            return 1;
         }
     }
+    return 0;
 }
 
-// 任务3：按拓扑顺序检查时间戳并判断是否需要构建
-void check_timestamps_and_build(MakefileData* data, DependencyGraph* graph, 
+// 评估一个节点(调用时它的所有依赖都已有结论)，每个节点每轮只评估一次：
+// 普通文件和不需要构建的目标为NODE_UP_TO_DATE；依赖构建失败或缺失时为NODE_FAILED；
+// 需要执行命令时为NODE_DIRTY，由调用者执行后改为NODE_BUILT或NODE_FAILED。
+// 依赖的NODE_BUILT状态使依赖它的目标变脏，变化由此沿图向下传播
+static NodeState evaluate_node(MakefileData* data, DependencyGraph* graph, const NodeState* state,
+                               int node_idx, int* changed_dep) {
+    *changed_dep = -1;
+    Rule* rule = find_rule_by_symbol(data, node_idx);
+    if (!rule) {
+        return NODE_UP_TO_DATE;
+    }
+    const char* name = node_name(graph, node_idx);
+
+    for (int e = graph->in_offset[node_idx]; e < graph->in_offset[node_idx + 1]; e++) {
+        int dep = graph->in_edges[e];
+        if (state[dep] == NODE_FAILED) {
+            printf("  跳过目标 %s: 依赖 %s 构建失败\n", name, node_name(graph, dep));
+            return NODE_FAILED;
+        }
+    }
+
+    if (!need_rebuild_target(graph, rule, node_idx, state, changed_dep)) {
+        remember_up_to_date(graph, rule, node_idx);
+        return NODE_UP_TO_DATE;
+    }
+
+    // 检查规则列出的依赖是否存在(依赖目标此时都已构建完成)，depfile中的依赖可以已被删除
+    int all_deps_exist = 1;
+    int first = graph->in_offset[node_idx];
+    for (int e = first; e < first + rule->dep_count; e++) {
+        int dep = graph->in_edges[e];
+        if (!stat_node(graph, dep)->exists) {
+            add_error(data, "错误: 目标 %s 的依赖 %s 不存在 (行号: %d)",
+                      name, node_name(graph, dep), rule->line_num);
+            printf("  错误: 依赖 %s 不存在\n", node_name(graph, dep));
+            all_deps_exist = 0;
+        }
+    }
+    return all_deps_exist ? NODE_DIRTY : NODE_FAILED;
+}
+
+// 任务3：按拓扑顺序串行检查时间戳并构建。拓扑序保证评估一个目标时它的依赖都已有结论，
+// 因此每个节点只stat和判断一次，共享的子图不会被重复评估或重复构建。
+// 命令失败的目标及依赖它的目标不再构建，其余目标继续。返回0表示全部成功
+int check_timestamps_and_build(MakefileData* data, DependencyGraph* graph, 
                                int* topo_order, int order_size) {
     printf("\n===== 开始时间戳检查与构建判断 =====\n");
+    NodeState* state = (NodeState*)calloc(graph->node_count > 0 ? graph->node_count : 1,
+                                          sizeof(NodeState));
+    int failed = 0;
 
     for (int i = 0; i < order_size; i++) {
         int node_idx = topo_order[i];
-        const char* node_name = graph->nodes[node_idx];
-
-        // 只处理目标节点
-        if (!is_target(data, node_name)) {
+        if (!node_needed(graph, node_idx)) {
             continue;
         }
+        Rule* rule = find_rule_by_symbol(data, node_idx);
+        if (rule) {
+            printf("\n处理目标: %s (行号: %d)\n", node_name(graph, node_idx), rule->line_num);
+        }
 
-        Rule* rule = find_rule_by_target(data, node_name);
+        int changed_dep;
+        state[node_idx] = evaluate_node(data, graph, state, node_idx, &changed_dep);
         if (!rule) {
             continue;
         }
+        const char* name = node_name(graph, node_idx);
+        if (state[node_idx] == NODE_UP_TO_DATE) {
+            printf("  目标已是最新，无需构建\n");
+            continue;
+        }
+        if (state[node_idx] != NODE_DIRTY) {
+            failed = 1;
+            continue;
+        }
 
-        printf("\n处理目标: %s (行号: %d)\n", node_name, rule->line_num);
-        
-        // 先递归构建所有依赖
-        for (int j = 0; j < rule->dep_count; j++) {
-            const char* dep_name = rule->dependencies[j];
-            printf("  检查依赖: %s\n", dep_name);
-            build_dependency(data, graph, topo_order, order_size, dep_name);
-        }
-
-        // 检查当前目标是否需要构建
-        int target_exists = file_exists(node_name);
-        time_t target_mtime = target_exists ? get_file_mtime(node_name) : 0;
-        int need_rebuild = !target_exists;
-
-        // 检查依赖是否有更新（经过递归构建后）
-        if (!need_rebuild) {
-            for (int j = 0; j < rule->dep_count; j++) {
-                const char* dep_name = rule->dependencies[j];
-                if (file_exists(dep_name) && get_file_mtime(dep_name) > target_mtime) {
-                    printf("  依赖 %s 比目标更新 (%.2f秒)\n", 
-                           dep_name, difftime(get_file_mtime(dep_name), target_mtime));
-                    need_rebuild = 1;
-                    break;
-                }
+        if (changed_dep != -1) {
+            const StatEntry* dep_stat = stat_node(graph, changed_dep);
+            const StatEntry* target_stat = stat_node(graph, node_idx);
+            if (state[changed_dep] == NODE_BUILT) {
+                printf("  依赖 %s 已重新构建\n", node_name(graph, changed_dep));
+            } else if (!dep_stat->exists) {
+                printf("  依赖 %s 已不存在\n", node_name(graph, changed_dep));
+            } else {
+                printf("  依赖 %s 比目标更新 (%.3f秒)\n", node_name(graph, changed_dep),
+                       mtime_diff(&dep_stat->mtime, &target_stat->mtime));
             }
+        } else if (stat_node(graph, node_idx)->exists) {
+            printf("  目标的命令已改变\n");
         }
+        printf("  开始构建 %s...\n", name);
 
-        // 执行构建
-        if (need_rebuild) {
-            printf("  开始构建 %s...\n", node_name);
-            
-            // 检查所有依赖是否存在（经过递归构建后应该都存在）
-            int all_deps_exist = 1;
-            for (int j = 0; j < rule->dep_count; j++) {
-                const char* dep_name = rule->dependencies[j];
-                if (!file_exists(dep_name)) {
-                    if (data->error_count < 100) {
-                        sprintf(data->errors[data->error_count], 
-                                "错误: 目标 %s 的依赖 %s 不存在 (行号: %d)",
-                                node_name, dep_name, rule->line_num);
-                        data->error_count++;
-                    }
-                    printf("  错误: 依赖 %s 不存在\n", dep_name);
-                    all_deps_exist = 0;
+        double start = monotonic_seconds();
+        int ok = run_rule_commands(rule, name);
+        invalidate_stat(graph, node_idx);
+        if (ok) {
+            state[node_idx] = NODE_BUILT;
+            remember_duration(graph, node_idx, monotonic_seconds() - start);
+            remember_build(graph, rule, node_idx);
+        } else {
+            state[node_idx] = NODE_FAILED;
+            add_error(data, "错误: 目标 %s 的命令执行失败 (行号: %d)", name, rule->line_num);
+            failed = 1;
+        }
+    }
+    free(state);
+
+    // 打印所有错误信息
+    if (data->error_count > 0) {
+        printf("\n===== 构建错误汇总 =====\n");
+        for (int i = 0; i < data->error_count; i++) {
+            printf("%s\n", data->errors[i]);
+        }
+    }
+    return failed;
+}
+
+// 节点完成后释放所有依赖它的节点：入度减为0时按优先级放入就绪队列
+static void release_dependents(DependencyGraph* graph, int* in_degree_copy, PriorityQueue* ready,
+                               const double* priority, int u) {
+    for (int e = graph->out_offset[u]; e < graph->out_offset[u + 1]; e++) {
+        int v = graph->out_edges[e];
+        if (!node_needed(graph, v)) {
+            continue;
+        }
+        in_degree_copy[v]--;
+        if (in_degree_copy[v] == 0) {
+            priority_push(ready, v, priority[v]);
+        }
+    }
+}
+
+// 计算每个节点的调度优先级：从该节点到最终目标的最长加权路径(含节点自身)。
+// 有命令的目标以历史耗时为权重(没有记录时取平均值)，其余节点权重为0。
+// 按拓扑序逆序计算，依赖它的节点总是先算好
+static double* critical_path_priorities(MakefileData* data, DependencyGraph* graph,
+                                        const int* topo_order, int order_size) {
+    double* priority = (double*)calloc(graph->node_count > 0 ? graph->node_count : 1, sizeof(double));
+    double fallback = graph->history != NULL ? build_history_mean(graph->history) : 1.0;
+    for (int i = order_size - 1; i >= 0; i--) {
+        int u = topo_order[i];
+        Rule* rule = find_rule_by_symbol(data, u);
+        double weight = 0;
+        if (rule != NULL && rule->cmd_count > 0) {
+            weight = graph->history != NULL && graph->history->seconds[u] >= 0
+                     ? graph->history->seconds[u] : fallback;
+        }
+        double longest = 0;
+        for (int e = graph->out_offset[u]; e < graph->out_offset[u + 1]; e++) {
+            if (node_needed(graph, graph->out_edges[e]) && priority[graph->out_edges[e]] > longest) {
+                longest = priority[graph->out_edges[e]];
+            }
+        }
+        priority[u] = weight + longest;
+    }
+    return priority;
+}
+
+// 并行构建(-j N)：沿用Kahn算法，入度为0的目标进入就绪队列并分配给空闲的任务槽，
+// 同时最多运行jobs个子进程；子进程结束后回收并释放其下游目标。
+// 就绪目标按到最终目标的最长加权路径(关键路径)从长到短启动，使耗时长的链尽早开始。
+// 一个规则的多条命令在同一个任务槽内按顺序执行。与串行构建相同，命令失败的目标及依赖它的
+// 目标不再构建(失败的节点同样释放下游，由evaluate_node标记为跳过)，其余目标继续。返回0表示全部成功
+int parallel_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size, int jobs) {
+    printf("\n===== 开始并行构建 (-j %d) =====\n", jobs);
+    double* priority = critical_path_priorities(data, graph, topo_order, order_size);
+    if (graph->history != NULL && graph->history->recorded_count > 0) {
+        double longest = 0;
+        for (int i = 0; i < graph->node_count; i++) {
+            if (priority[i] > longest) {
+                longest = priority[i];
+            }
+        }
+        printf("按历史耗时估计的关键路径: %.3f秒\n", longest);
+    }
+
+    // 只统计需要构建的依赖：needed不一定对依赖封闭(如--watch只重建变化的下游)
+    int* in_degree_copy = (int*)malloc((graph->node_count > 0 ? graph->node_count : 1) * sizeof(int));
+    for (int i = 0; i < graph->node_count; i++) {
+        in_degree_copy[i] = 0;
+        for (int e = graph->in_offset[i]; e < graph->in_offset[i + 1]; e++) {
+            in_degree_copy[i] += node_needed(graph, graph->in_edges[e]);
+        }
+    }
+    NodeState* state = (NodeState*)calloc(graph->node_count > 0 ? graph->node_count : 1,
+                                          sizeof(NodeState));
+
+    // 任务槽：记录正在运行的子进程属于哪个节点、执行到第几条命令
+    pid_t* slot_pid = (pid_t*)malloc(jobs * sizeof(pid_t));
+    int* slot_node = (int*)malloc(jobs * sizeof(int));
+    int* slot_cmd = (int*)malloc(jobs * sizeof(int));
+    double* slot_start = (double*)malloc(jobs * sizeof(double));  // 当前命令的启动时间(跟踪用)
+    double* slot_began = (double*)malloc(jobs * sizeof(double));  // 目标第一条命令的启动时间
+    for (int i = 0; i < jobs; i++) {
+        slot_pid[i] = 0;
+    }
+    int running = 0;
+    int failed = 0;
+    int tokens = 0;  // 从jobserver取得的令牌数：第一个任务使用隐含令牌，之后每个任务一个
+
+    PriorityQueue* ready = create_priority_queue(graph->node_count);
+    for (int i = 0; i < graph->node_count; i++) {
+        if (in_degree_copy[i] == 0 && node_needed(graph, i)) {
+            priority_push(ready, i, priority[i]);
+        }
+    }
+
+    while (1) {
+        // 1. 在有空闲槽位时不断从就绪队列取节点
+        while (running < jobs && !priority_is_empty(ready)) {
+            // 已有任务在运行时，启动下一个任务前需要先从jobserver取得令牌；
+            // 暂时没有令牌就先等待自己的任务结束
+            if (running > 0 && tokens < running) {
+                if (!jobserver_try_acquire()) {
+                    break;
                 }
+                tokens++;
             }
+            int u = priority_pop(ready);
+            const char* name = node_name(graph, u);
+            Rule* rule = find_rule_by_symbol(data, u);
 
-            if (all_deps_exist) {
-                for (int j = 0; j < rule->cmd_count; j++) {
-                    printf("    执行命令: %s\n", rule->commands[j]);
-                    my_system(rule->commands[j]); // 实际执行命令
+            // 与串行构建共用评估逻辑：普通文件节点或已是最新的目标直接完成
+            int changed_dep;
+            state[u] = evaluate_node(data, graph, state, u, &changed_dep);
+            if (state[u] == NODE_UP_TO_DATE) {
+                if (rule) {
+                    printf("目标 %s 已是最新，无需构建\n", name);
                 }
+                release_dependents(graph, in_degree_copy, ready, priority, u);
+                continue;
+            }
+            if (state[u] == NODE_FAILED) {
+                failed = 1;
+                release_dependents(graph, in_degree_copy, ready, priority, u);
+                continue;
+            }
+
+            if (rule->cmd_count == 0) {
+                state[u] = NODE_BUILT;
+                release_dependents(graph, in_degree_copy, ready, priority, u);
+                continue;
+            }
+
+            // 找一个空闲槽位启动该规则的第一条命令
+            int slot = 0;
+            while (slot_pid[slot] != 0) {
+                slot++;
+            }
+            pid_t pid = start_rule_commands(rule, name, slot, 0, &slot_cmd[slot], &slot_start[slot]);
+            if (pid < 0) {
+                add_error(data, "错误: 目标 %s 的命令无法启动: %s (行号: %d)", name, rule->commands[0],
+                          rule->oneshell ? rule->line_num : rule->command_lines[0]);
+                state[u] = NODE_FAILED;
+                failed = 1;
+                release_dependents(graph, in_degree_copy, ready, priority, u);
+                continue;
+            }
+            slot_pid[slot] = pid;
+            slot_node[slot] = u;
+            slot_began[slot] = monotonic_seconds();
+            running++;
+        }
+
+        if (running == 0) {
+            break;  // 没有运行中的任务，且就绪队列已空
+        }
+
+        // 等待前归还多余的令牌(运行中的任务只需running-1个)，让其他进程可以使用
+        while (tokens > running - 1) {
+            jobserver_release();
+            tokens--;
+        }
+
+        // 2. 回收一个结束的子进程
+        pid_t pid;
+        struct rusage usage = {0};
+        int status = my_system_wait(&pid, &usage);
+        if (pid < 0) {
+            failed = 1;
+            break;
+        }
+        int slot = -1;
+        for (int i = 0; i < jobs; i++) {
+            if (slot_pid[i] == pid) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == -1) {
+            continue;  // 不是本调度器启动的子进程
+        }
+
+        int u = slot_node[slot];
+        Rule* rule = find_rule_by_symbol(data, u);
+        const char* name = node_name(graph, u);
+        slot_pid[slot] = 0;
+        running--;
+        invalidate_stat(graph, u);  // 命令可能已生成/修改目标文件
+        int cmd = rule->oneshell ? 0 : slot_cmd[slot];
+        trace_command(name, rule->commands[cmd],
+                      rule->oneshell ? rule->line_num : rule->command_lines[cmd],
+                      slot + 1, slot_start[slot], &usage, status);
+
+        if (status != 0) {
+            if (rule->oneshell) {
+                add_error(data, "错误: 目标 %s 的.ONESHELL命令执行失败 (返回值: %d, 行号: %d)",
+                          name, status, rule->line_num);
+            } else {
+                add_error(data, "错误: 目标 %s 的命令执行失败: %s (返回值: %d, 行号: %d)",
+                          name, rule->commands[slot_cmd[slot]], status,
+                          rule->command_lines[slot_cmd[slot]]);
+            }
+            printf("  错误: 目标 %s 构建失败，依赖它的目标不再构建\n", name);
+            state[u] = NODE_FAILED;
+            failed = 1;
+            release_dependents(graph, in_degree_copy, ready, priority, u);
+            continue;
+        }
+
+        // 3. 同一规则还有命令则在原槽位继续执行，否则释放下游目标
+        if (slot_cmd[slot] + 1 < rule->cmd_count) {
+            int next = slot_cmd[slot] + 1;
+            pid_t next_pid = start_rule_commands(rule, name, slot, next, &slot_cmd[slot], &slot_start[slot]);
+            if (next_pid < 0) {
+                add_error(data, "错误: 目标 %s 的命令无法启动: %s (行号: %d)", name, rule->commands[next],
+                          rule->oneshell ? rule->line_num : rule->command_lines[next]);
+                state[u] = NODE_FAILED;
+                failed = 1;
+                release_dependents(graph, in_degree_copy, ready, priority, u);
+                continue;
             }
+            slot_pid[slot] = next_pid;
+            running++;
         } else {
-            printf("  目标已是最新，无需构建\n");
+            state[u] = NODE_BUILT;
+            remember_duration(graph, u, monotonic_seconds() - slot_began[slot]);
+            remember_build(graph, rule, u);
+            release_dependents(graph, in_degree_copy, ready, priority, u);
         }
     }
+    while (tokens > 0) {
+        jobserver_release();
+        tokens--;
+    }
 
-    // 打印所有错误信息
     if (data->error_count > 0) {
         printf("\n===== 构建错误汇总 =====\n");
         for (int i = 0; i < data->error_count; i++) {
             printf("%s\n", data->errors[i]);
         }
     }
+
+    free_priority_queue(ready);
+    free(slot_began);
+    free(slot_start);
+    free(slot_cmd);
+    free(slot_node);
+    free(slot_pid);
+    free(state);
+    free(in_degree_copy);
+    free(priority);
+    return failed;
 }
 
-// 测试函数，接收MakefileData参数
-void test(MakefileData* data) {
-    if (data == NULL || data->rule_count == 0) {
+// 构建前的准备：建依赖图、确定构建目标、检查依赖、加载构建数据库并拓扑排序
+// (各阶段在--trace时记录为时间线上的span)。失败时返回NULL
+DependencyGraph* prepare_build(MakefileData* data, const char** goals, int goal_count,
+                               int** topo_order, int* order_size) {
+    if (data == NULL) {
         printf("无效的Makefile数据或没有规则\n");
-        return;
+        return NULL;
+    }
+
+    // 为构建目标及其传递依赖中没有规则的文件(以及没有命令的显式规则)实例化模式规则，
+    // 依赖图随后包含这些规则。查找时stat过的文件按符号ID缓存，建图后直接沿用
+    double phase_start = trace_now();
+    StatEntry* resolved_stats = NULL;
+    int resolved_count = 0;
+    resolve_implicit_rules(data, goals, goal_count, &resolved_stats, &resolved_count);
+    trace_phase("resolve_patterns", phase_start);
+    if (data->rule_count == 0) {
+        printf("无效的Makefile数据或没有规则\n");
+        free(resolved_stats);
+        return NULL;
     }
     
     // 构建依赖图
+    phase_start = trace_now();
     DependencyGraph* graph = build_dependency_graph(data);
+    trace_phase("build_graph", phase_start);
+    if (graph == NULL) {
+        free(resolved_stats);
+        return NULL;
+    }
+    if (resolved_count > 0) {
+        memcpy(graph->stat_cache, resolved_stats,
+               (resolved_count < graph->node_count ? resolved_count : graph->node_count) * sizeof(StatEntry));
+    }
+    free(resolved_stats);
+
+    // 确定构建目标及其依赖闭包，之后只检查闭包内的规则
+    phase_start = trace_now();
+    int goal_status = select_goals(data, graph, goals, goal_count);
+    trace_phase("select_goals", phase_start);
+    if (goal_status != 0) {
+        for (int i = 0; i < data->error_count; i++) {
+            printf("Error: %s\n", data->errors[i]);
+        }
+        printf("构建目标无效，无法继续执行\n");
+        free_graph(graph);
+        return NULL;
+    }
+
+    // 检查所需规则的依赖是否有效(与后续构建共用图上的stat缓存)
+    phase_start = trace_now();
+    check_dependencies(data, graph);
+    trace_phase("check_dependencies", phase_start);
+    if (data->error_count > 0) {
+        for (int i = 0; i < data->error_count; i++) {
+            printf("Error: %s\n", data->errors[i]);
+        }
+        printf("Makefile解析失败，无法继续执行\n");
+        free_graph(graph);
+        return NULL;
+    }
+
+    // 加载内容哈希构建数据库
+    phase_start = trace_now();
+    graph->build_db = build_db_load(graph, BUILD_DB_FILE);
+    graph->history = build_history_load(graph, BUILD_HISTORY_FILE);
+    trace_phase("load_build_db", phase_start);
     
     // 打印依赖图
     print_dependency_graph(graph);
     
-    // 拓扑排序
-    int order_size;
-    int* topo_order = topological_sort(graph, &order_size);
+    // 拓扑排序(规则取自缓存且节点表未变时直接使用缓存的顺序)；新解析的结果连同依赖图写入缓存
+    phase_start = trace_now();
+    *topo_order = makefile_cache_topo(data->cache, graph, order_size);
+    if (*topo_order == NULL) {
+        *topo_order = topological_sort(graph, order_size);
+        makefile_cache_save(data->cache, data, graph, *topo_order, *order_size);
+    }
+    trace_phase("topological_sort", phase_start);
     
     // 打印拓扑排序结果
     printf("===== 拓扑排序结果 =====\n");
-    for (int i = 0; i < order_size; i++) {
-        printf("%s ", graph->nodes[topo_order[i]]);
+    for (int i = 0; i < *order_size; i++) {
+        printf("%s ", node_name(graph, (*topo_order)[i]));
     }
     printf("\n");
+    return graph;
+}
+
+// 对graph->needed中的节点执行一轮时间戳检查和构建，并写回构建数据库。返回0表示成功
+int run_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size, int jobs) {
+    int status = 0;
+    double phase_start = trace_now();
+    if (jobs > 0) {
+        status = parallel_build(data, graph, topo_order, order_size, jobs);
+    } else {
+        status = check_timestamps_and_build(data, graph, topo_order, order_size);
+    }
+    trace_phase("build", phase_start);
+    trace_counter("stat", "calls", graph->stat_calls);
+    trace_counter("stat", "cache_hits", graph->stat_hits);
     
-    // 执行时间戳检查和构建判断
-    check_timestamps_and_build(data, graph, topo_order, order_size);
-    
-    // 释放资源
+    // 写回构建数据库(记录本轮成功构建的目标)
+    phase_start = trace_now();
+    build_db_save(graph->build_db, graph, BUILD_DB_FILE);
+    build_history_save(graph->history, graph, BUILD_HISTORY_FILE);
+    trace_phase("save_build_db", phase_start);
+    return status;
+}
+
+// 释放prepare_build创建的依赖图、拓扑序和构建数据库
+void release_build(DependencyGraph* graph, int* topo_order) {
     free(topo_order);
+    build_db_free(graph->build_db);
+    build_history_free(graph->history);
     free_graph(graph);
 }
 
-
+// 测试函数，接收MakefileData参数；只构建goals(为空时构建默认目标)及其依赖，
+// jobs>0时使用并行调度器构建
+int test(MakefileData* data, int jobs, const char** goals, int goal_count) {
+    int* topo_order;
+    int order_size;
+    DependencyGraph* graph = prepare_build(data, goals, goal_count, &topo_order, &order_size);
+    if (graph == NULL) {
+        return 1;
+    }
+    int status = run_build(data, graph, topo_order, order_size, jobs);
+    release_build(graph, topo_order);
+    return status;
+}
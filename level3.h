@@ -1,47 +1,109 @@
 #ifndef LEVEL3_H
 #define LEVEL3_H
 
+#include <time.h>
 #include "level2.h"
 #include "level4.h"
+#include "build_db.h"
+#include "build_history.h"
+#include "makefile_cache.h"
+#include "jobserver.h"
+#include "trace.h"
 
-#define MAX_FILENAME_LEN 33   // 文件名最大长度(含结束符)
-#define MAX_DEPENDENCIES 50   // 每个目标最大依赖数量
-#define MAX_COMMANDS 20       // 每个目标最大命令数量
-#define MAX_LINE_LENGTH 1024
-#define MAX_TARGETS 100  // 最大目标数量
-#define MAX_NODES 256    // 最大节点数量
-#define MAX_ADJACENCY 64 // 每个节点最大邻接数量
 
-// 依赖图数据结构
+// 文件状态缓存项(每个节点一项，每轮构建中每个路径最多stat一次)
 typedef struct {
-    char* nodes[MAX_NODES];   // 所有节点(目标和依赖文件)
+    int valid;               // 是否已缓存
+    int exists;              // 文件是否存在
+    struct timespec mtime;   // 纳秒精度的修改时间(st_mtim)
+    long long size;          // 文件大小
+} StatEntry;
+
+// 依赖图数据结构(CSR压缩稀疏行格式)：节点下标即驻留表中的符号ID，名称通过symbols取得。
+// 节点u的正向边(依赖 -> 依赖它的目标)为 out_edges[out_offset[u] .. out_offset[u+1])，
+// 反向边(目标 -> 它的依赖)为 in_edges[in_offset[u] .. in_offset[u+1])。
+// 所有数组按解析出的规则精确分配
+typedef struct DependencyGraph {
+    const SymbolTable* symbols; // 节点名称来源(目标和依赖文件)
     int node_count;           // 节点总数
-    int adjacency[MAX_NODES][MAX_ADJACENCY];  // 邻接表
-    int adj_size[MAX_NODES];  // 每个节点的邻接数量
-    int in_degree[MAX_NODES]; // 每个节点的入度
+    int edge_count;           // 边总数
+    int* out_offset;          // 正向边起始位置(node_count+1项)
+    int* out_edges;           // 正向边终点(edge_count项)
+    int* in_offset;           // 反向边起始位置(node_count+1项)
+    int* in_edges;            // 反向边终点(edge_count项)
+    int* in_degree;           // 每个节点的入度
+    StatEntry* stat_cache;    // 按节点索引的stat缓存
+    long long stat_calls;     // 实际调用stat的次数
+    long long stat_hits;      // 命中stat缓存的次数
+    BuildDb* build_db;        // 内容哈希构建数据库(为NULL时只按mtime判断)
+    BuildHistory* history;    // 目标构建耗时历史(为NULL时不记录，调度按路径长度)
+    unsigned char* needed;    // 构建目标需要的节点(goal及其传递依赖)，为NULL时表示全部节点
 } DependencyGraph;
 
-// 队列结构(用于Kahn算法)
+// 构建过程中每个节点的状态，每轮构建中每个节点只评估一次
+typedef enum {
+    NODE_PENDING = 0,   // 尚未评估
+    NODE_UP_TO_DATE,    // 普通文件或已是最新的目标
+    NODE_DIRTY,         // 需要构建，命令尚未完成
+    NODE_BUILT,         // 本轮已重新构建(使依赖它的目标变脏)
+    NODE_FAILED         // 构建失败或因依赖失败而跳过
+} NodeState;
+
+// 队列结构(用于Kahn算法)，容量在创建时指定
 typedef struct {
-    int items[MAX_NODES];
+    int* items;
+    int capacity;
     int front;
     int rear;
     int size;
 } Queue;
 
-Queue* create_queue();
+// 并行调度的就绪队列：按优先级出队的二叉最大堆，优先级相同时先入队者先出
+typedef struct {
+    int node;
+    double priority;
+    int seq;
+} ReadyItem;
+
+typedef struct {
+    ReadyItem* items;
+    int capacity;
+    int size;
+    int next_seq;
+} PriorityQueue;
+
+Queue* create_queue(int capacity);
+void free_queue(Queue* q);
 void enqueue(Queue* q, int value);
 int dequeue(Queue* q);
 int is_empty(Queue* q);
+PriorityQueue* create_priority_queue(int capacity);
+void free_priority_queue(PriorityQueue* q);
+void priority_push(PriorityQueue* q, int node, double priority);
+int priority_pop(PriorityQueue* q);
+int priority_is_empty(PriorityQueue* q);
 int find_node_index(DependencyGraph* graph, const char* name);
-void add_node(DependencyGraph* graph, const char* name);
+const char* node_name(DependencyGraph* graph, int node_idx);
+DependencyGraph* build_dependency_graph(MakefileData* data);
+int refresh_depfile_edges(MakefileData* data, DependencyGraph* graph, int** topo_order, int* order_size);
 void print_dependency_graph(DependencyGraph* graph);
 int* topological_sort(DependencyGraph* graph, int* order_size);
 void free_graph(DependencyGraph* graph);
-int is_target(MakefileData* data, const char* name);
-time_t get_file_mtime(const char* filename);
-Rule* find_rule_by_target(MakefileData* data, const char* target);
-void build_dependency(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size, const char* dep_name);
-void check_timestamps_and_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size);
-void test(MakefileData* data);
+int node_needed(const DependencyGraph* graph, int node_idx);
+int default_goal(MakefileData* data);
+int select_goals(MakefileData* data, DependencyGraph* graph, const char** goals, int goal_count);
+const StatEntry* stat_node(DependencyGraph* graph, int node_idx);
+void stat_entry_load(StatEntry* entry, const char* path);
+void invalidate_stat(DependencyGraph* graph, int node_idx);
+int mtime_newer(const struct timespec* a, const struct timespec* b);
+int dep_changed(DependencyGraph* graph, int target_idx, int dep_idx, int dep_rebuilt);
+int commands_changed(DependencyGraph* graph, Rule* rule, int target_idx);
+Rule* find_rule_by_symbol(MakefileData* data, SymbolId symbol);
+int check_timestamps_and_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size);
+int parallel_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size, int jobs);
+DependencyGraph* prepare_build(MakefileData* data, const char** goals, int goal_count,
+                               int** topo_order, int* order_size);
+int run_build(MakefileData* data, DependencyGraph* graph, int* topo_order, int order_size, int jobs);
+void release_build(DependencyGraph* graph, int* topo_order);
+int test(MakefileData* data, int jobs, const char** goals, int goal_count);
 #endif
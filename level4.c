@@ -3,68 +3,177 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <errno.h>
+#include <spawn.h>
 #include "level4.h"
 
-// 使用execvp的自定义system()函数
+extern char **environ;
+
+// 需要shell解释的字符：管道、重定向、变量、引号、通配符、命令分隔等
+#define SHELL_METACHARS "|&;<>()$`\\\"'*?[]#~!{}\n"
+
+// 必须由shell执行的内建命令(没有同名可执行文件或语义依赖当前shell)。
+// test、true、false等在多数系统上也有可执行文件，但不能保证，同样交给shell
+static const char *shell_builtins[] = {
+    "cd", "export", "unset", "set", "exit", "exec", "eval", "source", ".",
+    "alias", "ulimit", "umask", "readonly", "shift", "trap", "wait", "return",
+    ":", "true", "false", "test", "command", "type", "hash", "read", "getopts",
+    "break", "continue", "times", "local", "jobs", "fg", "bg", NULL
+};
+
+// 判断命令是否需要通过shell执行：含元字符、第一个词是内建命令或形如VAR=value的赋值
+static int needs_shell(const char *command) {
+    if (strpbrk(command, SHELL_METACHARS) != NULL) {
+        return 1;
+    }
+    const char *start = command + strspn(command, " \t");
+    size_t len = strcspn(start, " \t");
+    if (len == 0 || memchr(start, '=', len) != NULL) {
+        return 1;
+    }
+    for (int i = 0; shell_builtins[i] != NULL; i++) {
+        if (strlen(shell_builtins[i]) == len && strncmp(start, shell_builtins[i], len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 按空白把命令拆成argv(命令中没有引号，拆分即可得到与shell相同的结果)；
+// 返回的argv和字符串共用一块内存，调用者free一次即可
+static char **split_command(const char *command) {
+    size_t len = strlen(command);
+    size_t max_args = len / 2 + 2;
+    char **argv = malloc(max_args * sizeof(char *) + len + 1);
+    char *copy = (char *)(argv + max_args);
+    memcpy(copy, command, len + 1);
+
+    int argc = 0;
+    for (char *p = copy; *p; ) {
+        while (*p == ' ' || *p == '\t') {
+            *p++ = '\0';
+        }
+        if (*p == '\0') {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t') {
+            p++;
+        }
+    }
+    argv[argc] = NULL;
+    return argv;
+}
+
+// 用posix_spawn启动命令(vfork语义，不复制父进程页表)：
+// 简单命令直接执行程序，只有确实需要shell的命令才经过sh -c。
+// 直接执行时找不到程序(可能是列表之外的shell内建命令)则改由sh -c执行，
+// 由shell判断并报告"命令不存在"。失败返回-1
+static pid_t spawn_command(const char *command) {
+    char *shell_args[] = { "sh", "-c", (char *)command, NULL };
+    char **argv = shell_args;
+    char **split = NULL;
+    if (!needs_shell(command)) {
+        split = split_command(command);
+        argv = split;
+    }
+
+    fflush(stdout);  // 保证子进程输出排在已打印的提示之后
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err == ENOENT && argv != shell_args) {
+        argv = shell_args;
+        err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    }
+    if (err != 0) {
+        fprintf(stderr, "无法执行命令 '%s': %s\n", argv[0], strerror(err));
+        pid = -1;
+    }
+    free(split);
+    return pid;
+}
+
+// 自定义system()：启动命令并等待其结束，返回退出状态
 int my_system(const char *command) {
+    return my_system_usage(command, NULL);
+}
+
+// 同my_system，并通过usage(可为NULL)返回子进程的资源使用情况；
+// 命令没能启动或等待失败时usage全部为0
+int my_system_usage(const char *command, struct rusage *usage) {
+    if (usage != NULL) {
+        memset(usage, 0, sizeof(*usage));
+    }
     if (command == NULL) {
         // 命令为NULL时返回非0值，表示存在shell
         return 1;
     }
 
-    pid_t pid = fork();  // 创建子进程
+    pid_t pid = spawn_command(command);
     if (pid < 0) {
-        // fork失败
-        perror("fork failed");
         return -1;
-    } 
-    // 子进程
-    else if (pid == 0) {
-        char *args[]={
-        "sh",
-        "-c",
-        (char*)command,
-        NULL
-        };
-        execvp("sh",args);
-        /*
-        // 拆分命令和参数
-        char *args[256];
-        char *cmd_copy = strdup(command);
-        int i = 0;
-        
-        // 按空格拆分命令
-        args[i] = strtok(cmd_copy, " ");
-        while (args[i] != NULL && i < 255) {
-            args[++i] = strtok(NULL, " ");
-        }
-        
-   
-        execvp(args[0], args);
-        */
-        
-        // 如果execvp执行失败才会到这里
-        perror("execvp failed");
-        //free(cmd_copy);
-        exit(EXIT_FAILURE);
-    } 
-    // 父进程
-    else {
-        int status;
-        // 等待子进程结束
-        if (waitpid(pid, &status, 0) == -1) {
-            perror("waitpid failed");
-            return -1;
-        }
-        
-        // 处理子进程退出状态
-        if (WIFEXITED(status)) {
-            return WEXITSTATUS(status);//非零值
-        } else {
-            // 子进程被信号终止等异常情况
-            return -1;
-        }
     }
+
+    int status;
+    // 等待子进程结束
+    if (wait4(pid, &status, 0, usage) == -1) {
+        perror("wait4 failed");
+        return -1;
+    }
+
+    // 处理子进程退出状态
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);//非零值
+    } else {
+        // 子进程被信号终止等异常情况
+        return -1;
+    }
+}
+
+// 异步版本：启动子进程执行命令后立即返回其pid，不等待结束（供并行构建使用）
+pid_t my_system_start(const char *command) {
+    return spawn_command(command);
+}
+
+// 把规则的整个命令列表拼成一个shell脚本(.ONESHELL)：set -e保证任一命令失败即停止，
+// 每条命令前记录其在Makefile中的行号，退出时由trap报告失败命令所在的行。返回值由调用者free
+char *oneshell_script(char *const *commands, const int *lines, int count) {
+    static const char header[] =
+        "set -e\n"
+        "trap '__minimake_status=$?; if [ $__minimake_status -ne 0 ]; then "
+        "echo \"错误: Makefile第${__minimake_line}行的命令执行失败 (返回值: $__minimake_status)\" >&2; "
+        "fi' EXIT\n";
+    size_t size = sizeof(header);
+    for (int i = 0; i < count; i++) {
+        size += strlen(commands[i]) + 32;
+    }
+    char *script = malloc(size);
+    char *p = script + sprintf(script, "%s", header);
+    for (int i = 0; i < count; i++) {
+        p += sprintf(p, "__minimake_line=%d\n%s\n", lines[i], commands[i]);
+    }
+    return script;
+}
+
+// 等待任意一个子进程结束，通过pid返回是哪个子进程、usage(可为NULL)返回其资源使用情况
+// (等待失败时全部为0)，返回值与my_system一致
+int my_system_wait(pid_t *pid, struct rusage *usage) {
+    if (usage != NULL) {
+        memset(usage, 0, sizeof(*usage));
+    }
+    int status;
+    pid_t done = wait4(-1, &status, 0, usage);
+    if (pid != NULL) {
+        *pid = done;
+    }
+    if (done == -1) {
+        perror("wait4 failed");
+        return -1;
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return -1;
 }
 
 // 执行构建步骤，任一命令失败则立即停止
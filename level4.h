@@ -1,7 +1,14 @@
 #ifndef LEVEL4_H
 #define LEVEL4_H
 
+#include <sys/types.h>
+#include <sys/resource.h>
+
 int my_system(const char *command);
+int my_system_usage(const char *command, struct rusage *usage);
+pid_t my_system_start(const char *command);
+int my_system_wait(pid_t *pid, struct rusage *usage);
+char *oneshell_script(char *const *commands, const int *lines, int count);
 int run_build_steps();
 
 
@@ -17,150 +17,393 @@ char* trim_whitespace(char *str) {
     return str;
 }
 
+// 哈希索引回调：取变量下标对应的变量名
+static const char* variable_key(const void *ctx, int idx) {
+    return ((const MakefileData *)ctx)->variables[idx].name;
+}
+
+// 初始化变量表和展开缓冲区
+void init_variables(MakefileData *data) {
+    data->variables = NULL;
+    data->var_count = 0;
+    data->var_capacity = 0;
+    data->var_generation = 0;
+    data->var_deps = NULL;
+    data->var_dep_count = 0;
+    data->var_dep_capacity = 0;
+    data->dep_mark = 0;
+    data->defer_automatic = false;
+    data->literal_dollars = 0;
+    hash_index_init(&data->var_index, variable_key, data);
+    data->expand_buffer.data = NULL;
+    data->expand_buffer.len = 0;
+    data->expand_buffer.capacity = 0;
+}
+
+// 释放变量索引和展开缓冲区(变量本身随arena释放)
+void free_variables(MakefileData *data) {
+    hash_index_free(&data->var_index);
+    free(data->var_deps);
+    data->var_deps = NULL;
+    data->var_dep_count = 0;
+    data->var_dep_capacity = 0;
+    free(data->expand_buffer.data);
+    data->expand_buffer.data = NULL;
+    data->expand_buffer.len = 0;
+    data->expand_buffer.capacity = 0;
+    data->variables = NULL;
+    data->var_count = 0;
+    data->var_capacity = 0;
+}
+
+// 按长度为len的变量名片段查找变量(哈希索引)，未找到返回NULL
+static Variable* lookup_variable(MakefileData *data, const char *var_name, size_t len) {
+    int idx = hash_index_find_n(&data->var_index, var_name, len);
+    return idx == -1 ? NULL : &data->variables[idx];
+}
+
 // 功能：根据变量名查找值，未找到返回NULL
 const char* find_variable(MakefileData *data, const char *var_name) {
-    for (int i = 0; i < data->var_count; i++) {
-        if (strcmp(data->variables[i].name, var_name) == 0) {
-            return data->variables[i].value;
+    return find_variable_n(data, var_name, strlen(var_name));
+}
+
+// 功能：根据长度为len的变量名片段查找存储的值(变量名不要求以'\0'结尾)
+const char* find_variable_n(MakefileData *data, const char *var_name, size_t len) {
+    Variable *var = lookup_variable(data, var_name, len);
+    return var != NULL ? var->value : NULL;
+}
+
+
+// 功能：新增变量，若已存在则覆盖；处理合法性检查。名称和值以视图传入，存储时才复制进arena。
+// recursive为true时值保存原始文本，使用时才展开
+void add_or_update_variable(MakefileData *data, StrView var_name, StrView var_value, bool recursive,
+                            int line_num) {
+    // 1. 检查变量名合法性（不能含空格、$、{、(）
+    for (size_t i = 0; i < var_name.len; i++) {
+        char c = var_name.ptr[i];
+        if (isspace((unsigned char)c) || c == '$' || c == '{' || c == '(') {
+            add_error(data, "Line%d: Invalid variable name '%.*s' (contains spaces/special chars)",
+                      line_num, (int)var_name.len, var_name.ptr);
+            return;
+        }
+    }
+
+    // 2. 覆盖已有变量/新增变量（名称和值按实际长度存入arena）
+    Variable *var = lookup_variable(data, var_name.ptr, var_name.len);
+    if (var == NULL) {
+        data->variables = arena_reserve(&data->arena, data->variables, &data->var_capacity,
+                                        data->var_count, sizeof(Variable));
+        var = &data->variables[data->var_count];
+        var->name = arena_strndup(&data->arena, var_name.ptr, var_name.len);
+        var->dep_mark = 0;
+        hash_index_insert(&data->var_index, var->name, data->var_count);
+        data->var_count++;
+    }
+    var->value = arena_strndup(&data->arena, var_value.ptr, var_value.len); // 覆盖旧值
+    var->recursive = recursive;
+    // 新的定义版本只使引用过该变量(直接或间接)的展开缓存失效
+    var->generation = ++data->var_generation;
+    var->expanded = NULL;
+}
+
+// 保证展开缓冲区还能追加extra字节(另留结束符)，容量按需倍增
+static void buffer_reserve(ExpandBuffer *buf, size_t extra) {
+    if (buf->len + extra + 1 > buf->capacity) {
+        size_t capacity = buf->capacity > 0 ? buf->capacity : 256;
+        while (buf->len + extra + 1 > capacity) {
+            capacity *= 2;
+        }
+        buf->data = realloc(buf->data, capacity);
+        buf->capacity = capacity;
+    }
+}
+
+static void buffer_append(ExpandBuffer *buf, const char *str, size_t len) {
+    buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+}
+
+// 查找与已读开括号匹配的闭括号：同类括号计数，因此 $(A_$(B)) 能取到完整的变量名。未找到返回NULL
+static const char *find_closing(const char *p, const char *end, char open, char close) {
+    int level = 1;
+    for (; p < end; p++) {
+        if (*p == open) {
+            level++;
+        } else if (*p == close && --level == 0) {
+            return p;
         }
     }
     return NULL;
 }
 
+static void expand_into(MakefileData *data, const char *input, size_t len, int depth, int line_num);
 
-// 功能：新增变量，若已存在则覆盖；处理合法性检查
-void add_or_update_variable(MakefileData *data, const char *var_name, const char *var_value, int line_num) {
-    // 1. 检查变量名合法性（不能含空格、$、{、(）
-    for (const char *p = var_name; *p; p++) {
-        if (isspace((unsigned char)*p) || *p == '$' || *p == '{' || *p == '(') {
-            add_error(data, "Line%d: Invalid variable name '%s' (contains spaces/special chars)", line_num, var_name);
-            return;
+// 记录当前展开过程引用了变量(及其当时的定义版本)
+static void note_dependency(MakefileData *data, int var_idx, unsigned generation) {
+    if (data->var_dep_count == data->var_dep_capacity) {
+        data->var_dep_capacity = data->var_dep_capacity > 0 ? data->var_dep_capacity * 2 : 64;
+        data->var_deps = realloc(data->var_deps, data->var_dep_capacity * sizeof(VarDep));
+    }
+    data->var_deps[data->var_dep_count].var = var_idx;
+    data->var_deps[data->var_dep_count].generation = generation;
+    data->var_dep_count++;
+}
+
+// 递归变量的展开缓存是否仍然有效：引用过的变量都没有重新定义
+static bool expansion_valid(const MakefileData *data, const Variable *var) {
+    if (var->expanded == NULL) {
+        return false;
+    }
+    for (int i = 0; i < var->expanded_dep_count; i++) {
+        if (data->variables[var->expanded_deps[i].var].generation != var->expanded_deps[i].generation) {
+            return false;
         }
     }
+    return true;
+}
 
-    // 2. 检查长度限制
-    if (strlen(var_name) >= MAX_VAR_NAME) {
-        add_error(data, "Line%d: Variable name '%s' too long (max %d chars)", line_num, var_name, MAX_VAR_NAME-1);
-        return;
+// 把展开过程从first开始记录的引用(去重后)保存为变量缓存的依赖列表
+static void save_dependencies(MakefileData *data, Variable *var, int first) {
+    unsigned mark = ++data->dep_mark;
+    int count = 0;
+    VarDep *deps = data->var_deps + first;
+    for (int i = first; i < data->var_dep_count; i++) {
+        Variable *dep = &data->variables[data->var_deps[i].var];
+        if (dep->dep_mark != mark) {
+            dep->dep_mark = mark;
+            deps[count++] = data->var_deps[i];
+        }
     }
-    if (strlen(var_value) >= MAX_VAR_VALUE) {
-        add_error(data, "Line%d: Value of '%s' too long (max %d chars)", line_num, var_name, MAX_VAR_VALUE-1);
-        return;
+    var->expanded_deps = count > 0 ? arena_alloc(&data->arena, count * sizeof(VarDep)) : NULL;
+    if (count > 0) {
+        memcpy(var->expanded_deps, deps, count * sizeof(VarDep));
     }
+    var->expanded_dep_count = count;
+    data->var_dep_count = first + count;  // 外层展开同样依赖这些变量
+}
 
-    // 3. 覆盖已有变量/新增变量
-    for (int i = 0; i < data->var_count; i++) {
-        if (strcmp(data->variables[i].name, var_name) == 0) {
-            strcpy(data->variables[i].value, var_value); // 覆盖旧值
-            return;
+// 把变量的值追加到缓冲区：简单变量直接使用定义时展开的值；递归变量的展开结果
+// 连同引用过的变量一起缓存，只有这些变量重新定义后才重新展开
+static void append_variable(MakefileData *data, Variable *var, int depth, int line_num) {
+    ExpandBuffer *buf = &data->expand_buffer;
+    note_dependency(data, (int)(var - data->variables), var->generation);
+    if (!var->recursive) {
+        buffer_append(buf, var->value, strlen(var->value));
+        return;
+    }
+    if (expansion_valid(data, var)) {
+        buffer_append(buf, var->expanded, strlen(var->expanded));  // 缓存仍然有效
+        for (int i = 0; i < var->expanded_dep_count; i++) {
+            note_dependency(data, var->expanded_deps[i].var, var->expanded_deps[i].generation);
         }
+        return;
     }
-    // 新增变量（未超过最大数量）
-    if (data->var_count < MAX_VARIABLES) {
-        strcpy(data->variables[data->var_count].name, var_name);
-        strcpy(data->variables[data->var_count].value, var_value);
-        data->var_count++;
-    } else {
-        add_error(data, "Line%d: Too many variables (max %d)", line_num, MAX_VARIABLES);
+    // 值中的嵌套引用直接展开到缓冲区末尾；展开无错误时才缓存结果。
+    // 含$$的值在命令中和其他位置展开的结果不同，不缓存
+    size_t start = buf->len;
+    int first_dep = data->var_dep_count;
+    int errors_before = data->error_count;
+    unsigned dollars_before = data->literal_dollars;
+    expand_into(data, var->value, strlen(var->value), depth + 1, line_num);
+    if (data->error_count == errors_before && data->literal_dollars == dollars_before) {
+        var->expanded = arena_strndup(&data->arena, buf->data + start, buf->len - start);
+        save_dependencies(data, var, first_dep);
     }
 }
 
-// 功能：处理 $(VAR) / ${VAR} 嵌套展开（如 PATH=$(HOME)/bin）
-void recursive_expand(MakefileData *data, const char *input, char *output, int depth, int line_num) {
+// 功能：处理 $(VAR) / ${VAR} 嵌套展开（如 PATH=$(HOME)/bin），输入为长度len的片段，
+// 结果追加到展开缓冲区。普通文本按段整体复制，$$表示字面的$
+static void expand_into(MakefileData *data, const char *input, size_t len, int depth, int line_num) {
     if (depth >= MAX_EXPAND_DEPTH) {
         add_error(data, "Line%d: Variable expansion loop (max depth %d)", line_num, MAX_EXPAND_DEPTH);
-        strcpy(output, "");
         return;
     }
 
+    ExpandBuffer *buf = &data->expand_buffer;
     const char *p = input;
-    char *out_p = output;
-    *out_p = '\0';
-
-    while (*p != '\0' && out_p - output < MAX_EXPANDED_LEN - 1) {
-        // 识别变量开头：$( 或 ${
-        if (*p == '$' && (p[1] == '(' || p[1] == '{')) {
-            char var_name[MAX_VAR_NAME] = {0};
-            const char *var_start = p + 2;
-            const char *var_end = (p[1] == '(') ? strchr(var_start, ')') : strchr(var_start, '}');
-
-            if (var_end == NULL) { // 无闭合符（如 $(CC）
-                add_error(data, "Line%d: Unclosed variable '%s'", line_num, p);
-                *out_p++ = *p++;
-                continue;
-            }
+    const char *end = input + len;
 
-            // 提取变量名
-            size_t var_len = var_end - var_start;
-            if (var_len >= MAX_VAR_NAME) {
-                add_error(data, "Line%d: Variable name too long '%.*s'", line_num, (int)var_len, var_start);
-                p = var_end + 1;
-                continue;
-            }
-            strncpy(var_name, var_start, var_len);
-
-            // 展开变量（未定义则为空）
-            const char *var_val = find_variable(data, var_name);
-            if (var_val == NULL) {
-                add_error(data, "Line%d: Undefined variable '%s'", line_num, var_name);
-                var_val = "";
-            }
+    while (p < end) {
+        const char *dollar = memchr(p, '$', end - p);
+        if (dollar == NULL) {
+            buffer_append(buf, p, end - p);
+            break;
+        }
+        buffer_append(buf, p, dollar - p);
+        p = dollar;
 
-            // 递归展开变量值中的嵌套变量
-            char expanded_val[MAX_EXPANDED_LEN] = {0};
-            recursive_expand(data, var_val, expanded_val, depth + 1, line_num);
+        if (p + 1 < end && p[1] == '$') {
+            buffer_append(buf, "$$", data->defer_automatic ? 2 : 1);
+            data->literal_dollars++;
+            p += 2;
+            continue;
+        }
+        // 识别变量开头：$( 或 ${，其他情况原样保留
+        if (p + 1 >= end || (p[1] != '(' && p[1] != '{')) {
+            buffer_append(buf, p, 1);
+            p++;
+            continue;
+        }
+        char open = p[1];
+        const char *name_start = p + 2;
+        const char *name_end = find_closing(name_start, end, open, open == '(' ? ')' : '}');
+        if (name_end == NULL) { // 无闭合符（如 $(CC）
+            add_error(data, "Line%d: Unclosed variable '%.*s'", line_num, (int)(end - p), p);
+            buffer_append(buf, p, 1);
+            p++;
+            continue;
+        }
 
-            // 追加到输出
-            strncat(out_p, expanded_val, MAX_EXPANDED_LEN - (out_p - output) - 1);
-            out_p += strlen(expanded_val);
-            p = var_end + 1; // 跳过当前变量
-        } else {
-            // 非变量字符直接复制
-            *out_p++ = *p++;
-            *out_p = '\0';
+        // 变量名本身含引用时先把名称展开到缓冲区末尾，查找后再丢弃
+        const char *name = name_start;
+        size_t name_len = name_end - name_start;
+        size_t mark = buf->len;
+        if (memchr(name, '$', name_len) != NULL) {
+            expand_into(data, name, name_len, depth + 1, line_num);
+            name = buf->data + mark;
+            name_len = buf->len - mark;
+        }
+        Variable *var = lookup_variable(data, name, name_len);
+        if (var == NULL) { // 未定义则为空
+            add_error(data, "Line%d: Undefined variable '%.*s'", line_num, (int)name_len, name);
         }
+        buf->len = mark;
+        if (var != NULL) {
+            append_variable(data, var, depth, line_num);
+        }
+        p = name_end + 1; // 跳过当前变量
     }
+}
 
-    // 防止溢出
-    if (out_p - output >= MAX_EXPANDED_LEN - 1) {
-        add_error(data, "Line%d: Expanded string too long (max %d chars)", line_num, MAX_EXPANDED_LEN - 1);
-        output[MAX_EXPANDED_LEN - 1] = '\0';
+// 变量展开对外接口 ---------------------------------------------------- 
+// 返回展开结果(以'\0'结尾，长度通过out_len返回)，内容位于展开缓冲区中，下一次展开前有效
+const char *expand_variable(MakefileData *data, const char *input, size_t len, size_t *out_len, int line_num) {
+    ExpandBuffer *buf = &data->expand_buffer;
+    buf->len = 0;
+    data->var_dep_count = 0;
+    expand_into(data, input, len, 0, line_num);
+    buffer_reserve(buf, 0);
+    buf->data[buf->len] = '\0';
+    if (out_len != NULL) {
+        *out_len = buf->len;
     }
+    return buf->data;
 }
 
-// 变量展开对外接口 ---------------------------------------------------- 
-void expand_variable(MakefileData *data, const char *input, char *output, int line_num) {
-    recursive_expand(data, input, output, 0, line_num);
+// 展开命令中的变量：$$和自动变量($@ $< $^ $*)原样保留，规则确定后由expand_automatic替换。
+// 返回值与expand_variable相同，位于展开缓冲区中
+const char *expand_command(MakefileData *data, const char *input, size_t len, size_t *out_len, int line_num) {
+    data->defer_automatic = true;
+    const char *result = expand_variable(data, input, len, out_len, line_num);
+    data->defer_automatic = false;
+    return result;
+}
+
+// 替换命令中的自动变量：$@为目标，$<为第一个依赖，$^为全部依赖，$*为模式规则的词干；
+// $$还原为$，其他$原样保留。input不能位于展开缓冲区中，结果写入展开缓冲区
+const char *expand_automatic(MakefileData *data, const char *input, size_t len, const Rule *rule,
+                             const char *stem, size_t *out_len) {
+    ExpandBuffer *buf = &data->expand_buffer;
+    buf->len = 0;
+    const char *p = input;
+    const char *end = input + len;
+    while (p < end) {
+        const char *dollar = memchr(p, '$', end - p);
+        if (dollar == NULL || dollar + 1 == end) {
+            buffer_append(buf, p, end - p);
+            break;
+        }
+        buffer_append(buf, p, dollar - p);
+        const char *name;
+        switch (dollar[1]) {
+        case '$':
+            buffer_append(buf, "$", 1);
+            break;
+        case '@':
+            name = symbol_name(&data->symbols, rule->target);
+            buffer_append(buf, name, strlen(name));
+            break;
+        case '<':
+            if (rule->dep_count > 0) {
+                name = symbol_name(&data->symbols, rule->dependencies[0]);
+                buffer_append(buf, name, strlen(name));
+            }
+            break;
+        case '^':
+            for (int i = 0; i < rule->dep_count; i++) {
+                name = symbol_name(&data->symbols, rule->dependencies[i]);
+                if (i > 0) {
+                    buffer_append(buf, " ", 1);
+                }
+                buffer_append(buf, name, strlen(name));
+            }
+            break;
+        case '*':
+            buffer_append(buf, stem, strlen(stem));
+            break;
+        default:
+            buffer_append(buf, dollar, 2);
+            break;
+        }
+        p = dollar + 2;
+    }
+    buffer_reserve(buf, 0);
+    buf->data[buf->len] = '\0';
+    if (out_len != NULL) {
+        *out_len = buf->len;
+    }
+    return buf->data;
 }
 
 // 变量定义解析函数 ---------------------------------------------------- 
-// 功能：识别 "VAR = VALUE" 语法，返回是否为变量行
-bool parse_variable_definition(MakefileData *data, const char *line, int line_num) {
-    char line_copy[MAX_LINE_LENGTH] = {0};
-    strcpy(line_copy, line);
-
-    // 分割变量名和值（以第一个 = 为界）
-    char *equal_pos = strchr(line_copy, '=');
-    if (equal_pos == NULL) {
+// 功能：识别 "VAR = VALUE"、"VAR := VALUE"、"VAR ?= VALUE"、"VAR += VALUE" 语法，返回是否为变量行。
+// line为映射内容中的一行，不复制
+bool parse_variable_definition(MakefileData *data, StrView line, int line_num) {
+    StrView var_name, var_val;
+    AssignOp op;
+    if (!view_split_assignment(line, &var_name, &op, &var_val)) {
         return false; // 不是变量行
     }
-
-    // 提取变量名（= 左边 trim 空白）
-    *equal_pos = '\0';
-    char *var_name = trim_whitespace(line_copy);
-    if (strlen(var_name) == 0) {
+    if (var_name.len == 0) {
         add_error(data, "Line%d: Empty variable name", line_num);
         return true; // 是变量行但格式错误
     }
 
-    // 提取变量值（= 右边 trim 空白，展开嵌套变量）
-    char *var_val_raw = trim_whitespace(equal_pos + 1);
-    char var_val_expanded[MAX_VAR_VALUE] = {0};
-    expand_variable(data, var_val_raw, var_val_expanded, line_num);
+    Variable *existing = lookup_variable(data, var_name.ptr, var_name.len);
+    if (op == ASSIGN_CONDITIONAL) {
+        if (existing == NULL) {
+            add_or_update_variable(data, var_name, var_val, true, line_num);
+        }
+        return true;
+    }
+    if (op == ASSIGN_RECURSIVE || (op == ASSIGN_APPEND && existing == NULL)) {
+        add_or_update_variable(data, var_name, var_val, true, line_num);  // 原样保存，使用时展开
+        return true;
+    }
+
+    // := 以及追加到简单变量：值在定义时展开(含$时才展开)
+    if ((op == ASSIGN_SIMPLE || !existing->recursive) && view_find(var_val, '$') != NULL) {
+        var_val.ptr = expand_variable(data, var_val.ptr, var_val.len, &var_val.len, line_num);
+    }
+    if (op == ASSIGN_SIMPLE) {
+        add_or_update_variable(data, var_name, var_val, false, line_num);
+        return true;
+    }
 
-    // 存储变量
-    add_or_update_variable(data, var_name, var_val_expanded, line_num);
+    // +=：以空格连接到已有值后面，保持原变量的展开方式
+    if (var_val.len == 0) {
+        return true;
+    }
+    size_t old_len = strlen(existing->value);
+    size_t new_len = old_len + (old_len > 0 ? 1 : 0) + var_val.len;
+    char *joined = arena_alloc(&data->arena, new_len + 1);
+    memcpy(joined, existing->value, old_len);
+    if (old_len > 0) {
+        joined[old_len] = ' ';
+    }
+    memcpy(joined + new_len - var_val.len, var_val.ptr, var_val.len);
+    StrView joined_view = { joined, new_len };
+    add_or_update_variable(data, var_name, joined_view, existing->recursive, line_num);
     return true;
 }
-
-
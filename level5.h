@@ -7,55 +7,148 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <stdarg.h>
+#include "hash_index.h"
+#include "arena.h"
+#include "symbol_table.h"
+#include "makefile_reader.h"
 
 
-#define MAX_LINE_LENGTH 1024
-#define MAX_TARGETS 100       // 最大目标数量
-#define MAX_DEPENDENCIES 50   // 每个目标最大依赖数量
-#define MAX_COMMANDS 20       // 每个目标最大命令数量
-#define MAX_FILENAME_LEN 33   // 文件名最大长度(含结束符)
-
 #define MAX_EXPAND_DEPTH 10    // 最大嵌套深度（防无限递归）
-#define MAX_EXPANDED_LEN 2048  // 展开后最大长度
 
-#define MAX_VAR_NAME 32       // 变量名最大长度（如 CC、CFLAGS）
-#define MAX_VAR_VALUE 512     // 变量值最大长度（如 gcc -Wall）
-#define MAX_VARIABLES 50      // 最大支持变量数量
 
+// 变量(名称和值都分配在arena中)
+// 展开结果依赖的一个变量及其当时的定义版本
+typedef struct {
+    int var;                  // 变量下标
+    unsigned generation;      // 展开时该变量的定义版本
+} VarDep;
 
 typedef struct {
-    char name[MAX_VAR_NAME];  // 变量名
-    char value[MAX_VAR_VALUE];// 变量值
+    char *name;               // 变量名
+    char *value;              // 变量值：递归变量为原始文本，简单变量为定义时已展开的结果
+    bool recursive;           // 是否为递归展开变量(= ?= 定义)，使用时才展开
+    unsigned generation;      // 定义版本：每次定义/修改该变量时更新
+    char *expanded;           // 递归变量的展开结果缓存(NULL表示尚未展开)
+    VarDep *expanded_deps;    // 缓存的展开过程引用过的全部变量(含间接引用)
+    int expanded_dep_count;
+    unsigned dep_mark;        // 合并依赖列表时去重用的标记
 } Variable;
 
-// 存储单个规则的结构体（原有结构不变）
+// 变量展开的输出缓冲区：整个展开过程(含嵌套引用)只写这一块内存，容量按需倍增
 typedef struct {
-    char target[MAX_FILENAME_LEN];       // 目标名称
-    char dependencies[MAX_DEPENDENCIES][MAX_FILENAME_LEN];  // 依赖列表
-    int dep_count;                       // 依赖数量
-    char commands[MAX_COMMANDS][MAX_LINE_LENGTH];  // 命令列表
-    int cmd_count;                       // 命令数量
-    int line_num;                        // 目标定义的行号
+    char *data;
+    size_t len;
+    size_t capacity;
+} ExpandBuffer;
+
+// 存储单个规则的结构体：目标和依赖都是驻留表中的符号ID，数组分配在MakefileData的arena中
+typedef struct {
+    SymbolId target;          // 目标名称
+    SymbolId *dependencies;   // 依赖列表
+    int dep_count;            // 依赖数量
+    char **commands;          // 命令列表
+    int *command_lines;       // 每条命令在Makefile中的行号
+    int cmd_count;            // 命令数量
+    int cmd_capacity;         // 命令数组容量
+    int line_num;             // 目标定义的行号
+    bool oneshell;            // 整个命令列表是否交给同一个shell执行(.ONESHELL)
 } Rule;
 
-// 存储所有规则和错误信息的全局结构（原有结构扩展）
+// 模式规则(如 "%.o: %.c")：目标和依赖中的%代表同一个词干，
+// 构建时只为需要的文件按需实例化为普通规则(见pattern_rules.c)
 typedef struct {
-    Rule rules[MAX_TARGETS];  // 规则数组
+    char *target;             // 目标模式原文(如 "build/%.o")，也是模式索引的键
+    size_t prefix_len;        // 目标模式中%之前的长度
+    size_t suffix_len;        // 目标模式中%之后的长度
+    char **dependencies;      // 依赖模式(变量已展开，可以不含%)
+    int dep_count;
+    char **commands;          // 命令(变量已展开，自动变量和$$留到实例化时替换)
+    int *command_lines;       // 每条命令在Makefile中的行号
+    int cmd_count;
+    int cmd_capacity;
+    int line_num;             // 模式规则定义的行号
+    int next_same_target;     // 目标模式相同的下一条模式规则(-1表示没有)
+} PatternRule;
+
+// 目标模式的形状：%前后的长度。匹配文件名时按形状截取前后缀拼成键查索引
+typedef struct {
+    size_t prefix_len;
+    size_t suffix_len;
+} PatternShape;
+
+// include/-include指令：列出的文件按gcc -MMD生成的depfile格式读取，
+// 其中的依赖在建依赖图时并入(见depfile.c)
+typedef struct {
+    char *files;              // 文件名列表(变量已展开，可含通配符)
+    int line_num;             // 指令所在行号
+    bool optional;            // -include/sinclude：文件不存在时忽略
+} DepfileInclude;
+
+// 存储所有规则和错误信息的全局结构（原有结构扩展）
+typedef struct MakefileData {
+    Arena arena;              // 规则、依赖、命令、变量的内存池，退出时一次释放
+
+    Rule *rules;              // 规则数组(按需倍增)
     int rule_count;           // 规则数量
+    int rule_capacity;        // 规则数组容量
     char errors[100][256];    // 错误信息
     int error_count;          // 错误数量
 
-    Variable variables[MAX_VARIABLES]; // 变量数组
-    int var_count;                     // 变量数量
+    Variable *variables;      // 变量数组(按需倍增)
+    int var_count;            // 变量数量
+    int var_capacity;         // 变量数组容量
+    HashIndex var_index;      // 变量名 -> 变量下标
+    ExpandBuffer expand_buffer; // 展开结果缓冲区(expand_variable返回的内容位于其中)
+    unsigned var_generation;  // 最近分配的变量定义版本(递增)
+    VarDep *var_deps;         // 当前展开过程依次引用的变量(展开缓存据此只在其依赖变化时失效)
+    int var_dep_count;
+    int var_dep_capacity;
+    unsigned dep_mark;        // 最近使用的去重标记
+
+    SymbolTable symbols;      // 目标/依赖文件名驻留表
+    int *rule_of_symbol;      // 符号ID -> 规则下标(-1表示该符号不是目标)
+    int rule_of_symbol_capacity;
+
+    bool oneshell_all;        // .ONESHELL没有列出目标：所有规则都使用单shell模式
+    SymbolId *oneshell_targets; // .ONESHELL中列出的目标
+    int oneshell_count;
+    int oneshell_capacity;
+
+    PatternRule *patterns;    // 模式规则数组(按需倍增)
+    int pattern_count;
+    int pattern_capacity;
+    HashIndex pattern_index;  // 目标模式原文 -> 第一条该目标模式的模式规则下标
+    PatternShape *pattern_shapes; // 出现过的目标模式形状，按前后缀总长从长到短排列(词干短的优先)
+    int shape_count;
+    int shape_capacity;
+    int current_pattern;      // 命令行所属的模式规则(-1表示属于最后一条普通规则，-2表示丢弃)
+
+    DepfileInclude *includes; // include指令列出的depfile
+    int include_count;
+    int include_capacity;
+
+    int parsed_rule_count;    // Makefile中写出的规则数；之后的规则由模式规则实例化
+    int parsed_symbol_count;  // 解析结束时的符号数；之后的符号由实例化或命令行目标引入
+
+    bool defer_automatic;     // 展开命令时保留$$和自动变量，由expand_automatic再替换
+    unsigned literal_dollars; // 已展开的$$个数：含$$的递归变量展开结果与上下文有关，不缓存
+
+    struct MakefileCache *cache; // 编译后Makefile缓存(可为NULL)，随数据一起释放
 } MakefileData;
 
 char *trim_whitespace(char *str);
 
+void init_variables(MakefileData *data);
+void free_variables(MakefileData *data);
 const char* find_variable(MakefileData *data, const char *var_name);
-void add_or_update_variable(MakefileData *data, const char *var_name, const char *var_value, int line_num);
-void recursive_expand(MakefileData *data, const char *input, char *output, int depth, int line_num);
-void expand_variable(MakefileData *data, const char *input, char *output, int line_num);
-bool parse_variable_definition(MakefileData *data, const char *line, int line_num);
+const char* find_variable_n(MakefileData *data, const char *var_name, size_t len);
+void add_or_update_variable(MakefileData *data, StrView var_name, StrView var_value, bool recursive,
+                            int line_num);
+const char *expand_variable(MakefileData *data, const char *input, size_t len, size_t *out_len, int line_num);
+const char *expand_command(MakefileData *data, const char *input, size_t len, size_t *out_len, int line_num);
+const char *expand_automatic(MakefileData *data, const char *input, size_t len, const Rule *rule,
+                             const char *stem, size_t *out_len);
+bool parse_variable_definition(MakefileData *data, StrView line, int line_num);
 
 
 
@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "makefile_cache.h"
+#include "build_db.h"
+#include "level3.h"
+#include "pattern_rules.h"
+
+#define CACHE_MAGIC "MMKCACHE"
+#define CACHE_VERSION 5
+#define CACHED_RULE_ONESHELL 1u  // CachedRule.flags：规则使用单shell模式
+#define CACHE_HAS_GRAPH 1u       // CacheHeader.flags：依赖图和拓扑顺序有效(没有模式规则和include时)
+#define CACHE_ONESHELL_ALL 2u    // CacheHeader.flags：.ONESHELL没有列出目标
+
+// 缓存文件头；其后依次是各个uint32/int32数组、Makefile路径和字符串区
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t path_len;         // Makefile路径长度(不含结束符)
+    uint64_t makefile_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t content_hash;
+    uint32_t symbol_count;
+    uint32_t rule_count;
+    uint32_t dep_total;        // 所有规则的依赖总数
+    uint32_t cmd_total;        // 所有规则的命令总数
+    uint32_t edge_count;
+    uint32_t topo_count;
+    uint32_t flags;
+    uint32_t pattern_count;
+    uint32_t pattern_dep_total; // 所有模式规则的依赖模式总数
+    uint32_t oneshell_count;    // .ONESHELL中列出的目标数
+    uint32_t include_count;     // include指令数
+    uint64_t strings_size;     // 字符串区字节数(每个字符串以'\0'结尾)
+    uint64_t symbol_hash;      // 依赖图节点表(按节点下标排列的全部名称)的哈希
+    uint64_t payload_hash;     // 文件头之后全部内容的哈希，用于发现损坏
+} CacheHeader;
+
+// 缓存中的一条规则，依赖和命令都是全局数组中的区间
+typedef struct {
+    uint32_t target;
+    uint32_t line_num;
+    uint32_t dep_start;
+    uint32_t dep_count;
+    uint32_t cmd_start;
+    uint32_t cmd_count;
+    uint32_t flags;
+} CachedRule;
+
+// 缓存中的一条模式规则：目标模式和依赖模式是字符串区中的偏移，命令与规则共用命令数组
+typedef struct {
+    uint32_t target;
+    uint32_t line_num;
+    uint32_t dep_start;
+    uint32_t dep_count;
+    uint32_t cmd_start;
+    uint32_t cmd_count;
+} CachedPattern;
+
+// 缓存中的一条include指令：文件列表是字符串区中的偏移
+typedef struct {
+    uint32_t files;
+    uint32_t line_num;
+    uint32_t optional;
+} CachedInclude;
+
+// 映射内容中各段的位置
+typedef struct {
+    const CacheHeader* header;
+    const uint32_t* symbol_offsets;  // 符号名在字符串区中的偏移
+    const CachedRule* rules;
+    const uint32_t* deps;
+    const uint32_t* command_offsets; // 命令在字符串区中的偏移
+    const uint32_t* command_lines;   // 命令在Makefile中的行号
+    const int32_t* out_offset;
+    const int32_t* out_edges;
+    const int32_t* in_offset;
+    const int32_t* in_edges;
+    const int32_t* in_degree;
+    const int32_t* topo;
+    const CachedPattern* patterns;
+    const uint32_t* pattern_deps;    // 依赖模式在字符串区中的偏移
+    const uint32_t* oneshell;        // .ONESHELL中列出的目标符号
+    const CachedInclude* includes;
+    const char* path;
+    const char* strings;
+} CacheSections;
+
+// 按文件头计算各段位置，返回整个缓存应有的字节数
+static uint64_t cache_layout(const char* base, CacheSections* sec) {
+    const CacheHeader* h = (const CacheHeader*)base;
+    uint64_t n = h->symbol_count;
+    const char* p = base + sizeof(CacheHeader);
+    sec->header = h;
+    sec->symbol_offsets = (const uint32_t*)p;   p += n * 4;
+    sec->rules = (const CachedRule*)p;          p += (uint64_t)h->rule_count * sizeof(CachedRule);
+    sec->deps = (const uint32_t*)p;             p += (uint64_t)h->dep_total * 4;
+    sec->command_offsets = (const uint32_t*)p;  p += (uint64_t)h->cmd_total * 4;
+    sec->command_lines = (const uint32_t*)p;    p += (uint64_t)h->cmd_total * 4;
+    sec->out_offset = (const int32_t*)p;        p += (n + 1) * 4;
+    sec->out_edges = (const int32_t*)p;         p += (uint64_t)h->edge_count * 4;
+    sec->in_offset = (const int32_t*)p;         p += (n + 1) * 4;
+    sec->in_edges = (const int32_t*)p;          p += (uint64_t)h->edge_count * 4;
+    sec->in_degree = (const int32_t*)p;         p += n * 4;
+    sec->topo = (const int32_t*)p;              p += (uint64_t)h->topo_count * 4;
+    sec->patterns = (const CachedPattern*)p;    p += (uint64_t)h->pattern_count * sizeof(CachedPattern);
+    sec->pattern_deps = (const uint32_t*)p;     p += (uint64_t)h->pattern_dep_total * 4;
+    sec->oneshell = (const uint32_t*)p;         p += (uint64_t)h->oneshell_count * 4;
+    sec->includes = (const CachedInclude*)p;    p += (uint64_t)h->include_count * sizeof(CachedInclude);
+    sec->path = p;                              p += (uint64_t)h->path_len + 1;
+    sec->strings = p;                           p += h->strings_size;
+    return (uint64_t)(p - base);
+}
+
+// FNV-1a：逐段累积计算缓存内容的校验哈希
+static uint64_t hash_update(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// 检查CSR偏移数组单调且以边数结尾，边的端点都在节点范围内
+static int valid_csr(const int32_t* offset, const int32_t* edges, uint32_t n, uint32_t edge_count) {
+    if (offset[0] != 0 || offset[n] != (int32_t)edge_count) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (offset[i] > offset[i + 1]) {
+            return 0;
+        }
+    }
+    for (uint32_t e = 0; e < edge_count; e++) {
+        if (edges[e] < 0 || (uint32_t)edges[e] >= n) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 校验缓存结构：所有下标和偏移都必须落在各自的范围内，避免损坏的缓存导致越界
+static int validate_cache(const char* base, size_t size) {
+    if (size < sizeof(CacheHeader)) {
+        return 0;
+    }
+    const CacheHeader* h = (const CacheHeader*)base;
+    if (memcmp(h->magic, CACHE_MAGIC, 8) != 0 || h->version != CACHE_VERSION
+        || h->symbol_count > INT32_MAX || h->edge_count > INT32_MAX || h->topo_count > h->symbol_count) {
+        return 0;
+    }
+    CacheSections sec;
+    if (cache_layout(base, &sec) != size || sec.path[h->path_len] != '\0'
+        || hash_update(0xCBF29CE484222325ull, base + sizeof(CacheHeader), size - sizeof(CacheHeader))
+               != h->payload_hash) {
+        return 0;
+    }
+    if (h->strings_size > 0 && sec.strings[h->strings_size - 1] != '\0') {
+        return 0;
+    }
+    uint32_t n = h->symbol_count;
+    for (uint32_t i = 0; i < n; i++) {
+        if (sec.symbol_offsets[i] >= h->strings_size) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->cmd_total; i++) {
+        if (sec.command_offsets[i] >= h->strings_size) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->dep_total; i++) {
+        if (sec.deps[i] >= n) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->rule_count; i++) {
+        const CachedRule* rule = &sec.rules[i];
+        if (rule->target >= n
+            || (uint64_t)rule->dep_start + rule->dep_count > h->dep_total
+            || (uint64_t)rule->cmd_start + rule->cmd_count > h->cmd_total) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->topo_count; i++) {
+        if (sec.topo[i] < 0 || (uint32_t)sec.topo[i] >= n) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->pattern_count; i++) {
+        const CachedPattern* pattern = &sec.patterns[i];
+        if (pattern->target >= h->strings_size || strchr(sec.strings + pattern->target, '%') == NULL
+            || (uint64_t)pattern->dep_start + pattern->dep_count > h->pattern_dep_total
+            || (uint64_t)pattern->cmd_start + pattern->cmd_count > h->cmd_total) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->pattern_dep_total; i++) {
+        if (sec.pattern_deps[i] >= h->strings_size) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->oneshell_count; i++) {
+        if (sec.oneshell[i] >= n) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->include_count; i++) {
+        if (sec.includes[i].files >= h->strings_size) {
+            return 0;
+        }
+    }
+    return valid_csr(sec.out_offset, sec.out_edges, n, h->edge_count)
+           && valid_csr(sec.in_offset, sec.in_edges, n, h->edge_count);
+}
+
+// 惰性计算Makefile内容哈希
+static int makefile_hash(MakefileCache* cache, uint64_t* hash) {
+    if (!cache->has_hash) {
+        int ok;
+        cache->content_hash = hash_file_content(cache->makefile_path, &ok);
+        if (!ok) {
+            return 0;
+        }
+        cache->has_hash = 1;
+    }
+    *hash = cache->content_hash;
+    return 1;
+}
+
+// 读取Makefile的键并映射缓存文件；键(路径、大小、mtime、内容哈希)全部一致且结构有效时hit=1。
+// Makefile本身无法stat时返回NULL
+MakefileCache* makefile_cache_open(const char* makefile_path, const char* cache_path) {
+    struct stat st;
+    if (stat(makefile_path, &st) != 0) {
+        return NULL;
+    }
+    MakefileCache* cache = (MakefileCache*)calloc(1, sizeof(MakefileCache));
+    cache->makefile_path = strdup(makefile_path);
+    cache->cache_path = strdup(cache_path);
+    cache->size = st.st_size;
+    cache->mtime = st.st_mtim;
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return cache;
+    }
+    struct stat cache_st;
+    if (fstat(fd, &cache_st) != 0 || cache_st.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return cache;
+    }
+    void* map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return cache;
+    }
+
+    // 先比较廉价的键(大小、mtime)，一致时才校验缓存内容并读取Makefile计算内容哈希
+    const CacheHeader* h = (const CacheHeader*)map;
+    uint64_t hash;
+    size_t path_len = strlen(makefile_path);
+    int match = h->path_len == path_len
+                && h->makefile_size == (uint64_t)cache->size
+                && h->mtime_sec == (int64_t)cache->mtime.tv_sec
+                && h->mtime_nsec == (int64_t)cache->mtime.tv_nsec
+                && validate_cache((const char*)map, cache_st.st_size);
+    if (match) {
+        CacheSections sec;
+        cache_layout((const char*)map, &sec);
+        match = memcmp(sec.path, makefile_path, path_len) == 0
+                && makefile_hash(cache, &hash) && hash == h->content_hash;
+    }
+    if (!match) {
+        munmap(map, cache_st.st_size);
+        return cache;
+    }
+    cache->map = (const char*)map;
+    cache->map_size = cache_st.st_size;
+    cache->hit = 1;
+    return cache;
+}
+
+// 从缓存载入符号表和规则，代替完整解析。失败时把data恢复为空并返回0，调用者应回退到完整解析
+int makefile_cache_load(MakefileCache* cache, MakefileData* data) {
+    if (cache == NULL || !cache->hit) {
+        return 0;
+    }
+    CacheSections sec;
+    cache_layout(cache->map, &sec);
+    const CacheHeader* h = sec.header;
+
+    // 按原顺序驻留符号，符号ID与缓存中的节点下标一一对应
+    for (uint32_t i = 0; i < h->symbol_count; i++) {
+        if (intern_symbol(&data->symbols, sec.strings + sec.symbol_offsets[i]) != i) {
+            free_makefile_data(data);  // 重复的符号名：缓存已损坏
+            init_makefile_data(data);
+            cache->hit = 0;
+            return 0;
+        }
+    }
+
+    int n = (int)h->symbol_count;
+    if (n > 0) {
+        data->rule_of_symbol = arena_alloc(&data->arena, n * sizeof(int));
+        memset(data->rule_of_symbol, 0xff, n * sizeof(int));  // 全部置为-1
+        data->rule_of_symbol_capacity = n;
+    }
+    if (h->rule_count > 0) {
+        data->rules = arena_alloc(&data->arena, h->rule_count * sizeof(Rule));
+        data->rule_capacity = h->rule_count;
+    }
+    for (uint32_t i = 0; i < h->rule_count; i++) {
+        const CachedRule* cached = &sec.rules[i];
+        Rule* rule = &data->rules[i];
+        rule->target = cached->target;
+        rule->line_num = cached->line_num;
+        rule->dep_count = cached->dep_count;
+        rule->cmd_count = cached->cmd_count;
+        rule->cmd_capacity = cached->cmd_count;
+        rule->oneshell = (cached->flags & CACHED_RULE_ONESHELL) != 0;
+        if (cached->dep_count > 0) {
+            rule->dependencies = arena_alloc(&data->arena, cached->dep_count * sizeof(SymbolId));
+            memcpy(rule->dependencies, sec.deps + cached->dep_start, cached->dep_count * sizeof(SymbolId));
+        }
+        if (cached->cmd_count > 0) {
+            rule->commands = arena_alloc(&data->arena, cached->cmd_count * sizeof(char*));
+            rule->command_lines = arena_alloc(&data->arena, cached->cmd_count * sizeof(int));
+            for (uint32_t j = 0; j < cached->cmd_count; j++) {
+                rule->commands[j] = arena_strdup(&data->arena,
+                                                 sec.strings + sec.command_offsets[cached->cmd_start + j]);
+                rule->command_lines[j] = (int)sec.command_lines[cached->cmd_start + j];
+            }
+        }
+        if (data->rule_of_symbol[rule->target] != -1) {
+            free_makefile_data(data);  // 重复目标不可能出现在有效的缓存中
+            init_makefile_data(data);
+            cache->hit = 0;
+            return 0;
+        }
+        data->rule_of_symbol[rule->target] = i;
+    }
+    data->rule_count = h->rule_count;
+
+    // 模式规则和.ONESHELL设置：之后按需实例化的规则还要用到
+    for (uint32_t i = 0; i < h->pattern_count; i++) {
+        const CachedPattern* cached = &sec.patterns[i];
+        const char* target = sec.strings + cached->target;
+        PatternRule* pattern = add_pattern_rule(data, target, strlen(target), (int)cached->line_num);
+        if (cached->dep_count > 0) {
+            pattern->dependencies = arena_alloc(&data->arena, cached->dep_count * sizeof(char*));
+        }
+        for (uint32_t j = 0; j < cached->dep_count; j++) {
+            pattern->dependencies[j] = arena_strdup(&data->arena,
+                                                    sec.strings + sec.pattern_deps[cached->dep_start + j]);
+        }
+        pattern->dep_count = cached->dep_count;
+        if (cached->cmd_count > 0) {
+            pattern->commands = arena_alloc(&data->arena, cached->cmd_count * sizeof(char*));
+            pattern->command_lines = arena_alloc(&data->arena, cached->cmd_count * sizeof(int));
+        }
+        for (uint32_t j = 0; j < cached->cmd_count; j++) {
+            pattern->commands[j] = arena_strdup(&data->arena,
+                                                sec.strings + sec.command_offsets[cached->cmd_start + j]);
+            pattern->command_lines[j] = (int)sec.command_lines[cached->cmd_start + j];
+        }
+        pattern->cmd_count = cached->cmd_count;
+        pattern->cmd_capacity = cached->cmd_count;
+    }
+    data->oneshell_all = (h->flags & CACHE_ONESHELL_ALL) != 0;
+    if (h->oneshell_count > 0) {
+        data->oneshell_targets = arena_alloc(&data->arena, h->oneshell_count * sizeof(SymbolId));
+        memcpy(data->oneshell_targets, sec.oneshell, h->oneshell_count * sizeof(SymbolId));
+        data->oneshell_count = data->oneshell_capacity = (int)h->oneshell_count;
+    }
+    if (h->include_count > 0) {
+        data->includes = arena_alloc(&data->arena, h->include_count * sizeof(DepfileInclude));
+        for (uint32_t i = 0; i < h->include_count; i++) {
+            const CachedInclude* cached = &sec.includes[i];
+            data->includes[i].files = arena_strdup(&data->arena, sec.strings + cached->files);
+            data->includes[i].line_num = (int)cached->line_num;
+            data->includes[i].optional = cached->optional != 0;
+        }
+        data->include_count = data->include_capacity = (int)h->include_count;
+    }
+    data->parsed_rule_count = data->rule_count;
+    data->parsed_symbol_count = data->symbols.count;
+    cache->loaded = 1;
+    return 1;
+}
+
+// 规则来自缓存时，直接复制缓存中的CSR数组作为依赖图，跳过计数和填充
+int makefile_cache_fill_graph(MakefileCache* cache, DependencyGraph* graph) {
+    if (cache == NULL || !cache->loaded || !(((const CacheHeader*)cache->map)->flags & CACHE_HAS_GRAPH)
+        || graph->node_count != (int)((const CacheHeader*)cache->map)->symbol_count) {
+        return 0;
+    }
+    CacheSections sec;
+    cache_layout(cache->map, &sec);
+    int n = graph->node_count;
+    int edges = (int)sec.header->edge_count;
+    graph->edge_count = edges;
+    graph->out_edges = (int*)malloc((edges > 0 ? edges : 1) * sizeof(int));
+    graph->in_edges = (int*)malloc((edges > 0 ? edges : 1) * sizeof(int));
+    memcpy(graph->out_offset, sec.out_offset, (n + 1) * sizeof(int));
+    memcpy(graph->in_offset, sec.in_offset, (n + 1) * sizeof(int));
+    memcpy(graph->in_degree, sec.in_degree, n * sizeof(int));
+    memcpy(graph->out_edges, sec.out_edges, edges * sizeof(int));
+    memcpy(graph->in_edges, sec.in_edges, edges * sizeof(int));
+    return 1;
+}
+
+// 依赖图节点表的哈希：按节点下标依次累积每个名称(含结尾的'\0')
+static uint64_t node_table_hash(DependencyGraph* graph) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int i = 0; i < graph->node_count; i++) {
+        const char* name = node_name(graph, i);
+        hash = hash_update(hash, name, strlen(name) + 1);
+    }
+    return hash;
+}
+
+// 规则来自缓存时返回缓存中的拓扑顺序(调用者释放)，否则返回NULL。
+// 只有当前依赖图的节点表与缓存保存时完全相同(节点数和名称哈希一致)、且拓扑顺序覆盖了全部节点时
+// 才能使用，否则(如depfile或模式规则带来了新节点)返回NULL，由调用者重新排序
+int* makefile_cache_topo(MakefileCache* cache, DependencyGraph* graph, int* order_size) {
+    if (cache == NULL || !cache->loaded || !(((const CacheHeader*)cache->map)->flags & CACHE_HAS_GRAPH)) {
+        return NULL;
+    }
+    CacheSections sec;
+    cache_layout(cache->map, &sec);
+    if (graph->node_count != (int)sec.header->symbol_count
+        || (int)sec.header->topo_count != graph->node_count
+        || node_table_hash(graph) != sec.header->symbol_hash) {
+        return NULL;
+    }
+    int count = (int)sec.header->topo_count;
+    int* order = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    memcpy(order, sec.topo, count * sizeof(int));
+    *order_size = count;
+    return order;
+}
+
+// 字符串区：所有符号名和命令依次存放，按需倍增
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} StringPool;
+
+static uint32_t pool_add(StringPool* pool, const char* str) {
+    size_t len = strlen(str) + 1;
+    if (pool->size + len > pool->capacity) {
+        size_t capacity = pool->capacity > 0 ? pool->capacity : 4096;
+        while (pool->size + len > capacity) {
+            capacity *= 2;
+        }
+        pool->data = (char*)realloc(pool->data, capacity);
+        pool->capacity = capacity;
+    }
+    memcpy(pool->data + pool->size, str, len);
+    uint32_t offset = (uint32_t)pool->size;
+    pool->size += len;
+    return offset;
+}
+
+// 写入一段内容并累积校验哈希(空段可能没有分配内存，直接跳过)
+static void cache_write(FILE* file, uint64_t* hash, const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    fwrite(data, 1, size, file);
+    *hash = hash_update(*hash, data, size);
+}
+
+// 解析成功后写入缓存：先写临时文件再改名，保证其他进程看到的缓存总是完整的。
+// 规则本就取自缓存时无需重写。有模式规则或include时只保存Makefile中写出的符号、规则、模式规则和include：
+// 实例化结果取决于构建目标和当时存在的文件，depfile的内容每次构建都可能变化，
+// 依赖图和拓扑顺序也随之不同，都不写入缓存
+int makefile_cache_save(MakefileCache* cache, MakefileData* data, DependencyGraph* graph,
+                        const int* topo_order, int order_size) {
+    if (cache == NULL || cache->hit || data->error_count > 0) {
+        return 0;
+    }
+    uint64_t hash;
+    if (!makefile_hash(cache, &hash)) {
+        return 1;
+    }
+
+    int with_graph = data->pattern_count == 0 && data->include_count == 0;
+    int n = with_graph ? graph->node_count : data->parsed_symbol_count;
+    int rule_count = with_graph ? data->rule_count : data->parsed_rule_count;
+    StringPool pool = {0};
+    uint32_t* symbol_offsets = (uint32_t*)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    for (int i = 0; i < n; i++) {
+        symbol_offsets[i] = pool_add(&pool, node_name(graph, i));
+    }
+    CachedRule* rules = (CachedRule*)malloc((rule_count > 0 ? rule_count : 1) * sizeof(CachedRule));
+    uint32_t dep_total = 0, cmd_total = 0, pattern_dep_total = 0;
+    for (int i = 0; i < rule_count; i++) {
+        dep_total += data->rules[i].dep_count;
+        cmd_total += data->rules[i].cmd_count;
+    }
+    for (int i = 0; i < data->pattern_count; i++) {
+        pattern_dep_total += data->patterns[i].dep_count;
+        cmd_total += data->patterns[i].cmd_count;
+    }
+    uint32_t* deps = (uint32_t*)malloc((dep_total > 0 ? dep_total : 1) * sizeof(uint32_t));
+    uint32_t* command_offsets = (uint32_t*)malloc((cmd_total > 0 ? cmd_total : 1) * sizeof(uint32_t));
+    uint32_t* command_lines = (uint32_t*)malloc((cmd_total > 0 ? cmd_total : 1) * sizeof(uint32_t));
+    uint32_t dep_pos = 0, cmd_pos = 0;
+    for (int i = 0; i < rule_count; i++) {
+        Rule* rule = &data->rules[i];
+        rules[i] = (CachedRule){ rule->target, (uint32_t)rule->line_num, dep_pos, (uint32_t)rule->dep_count,
+                                 cmd_pos, (uint32_t)rule->cmd_count,
+                                 rule->oneshell ? CACHED_RULE_ONESHELL : 0 };
+        for (int j = 0; j < rule->dep_count; j++) {
+            deps[dep_pos++] = rule->dependencies[j];
+        }
+        for (int j = 0; j < rule->cmd_count; j++) {
+            command_lines[cmd_pos] = (uint32_t)rule->command_lines[j];
+            command_offsets[cmd_pos++] = pool_add(&pool, rule->commands[j]);
+        }
+    }
+    CachedPattern* patterns = (CachedPattern*)malloc((data->pattern_count > 0 ? data->pattern_count : 1)
+                                                     * sizeof(CachedPattern));
+    uint32_t* pattern_deps = (uint32_t*)malloc((pattern_dep_total > 0 ? pattern_dep_total : 1)
+                                               * sizeof(uint32_t));
+    dep_pos = 0;
+    for (int i = 0; i < data->pattern_count; i++) {
+        PatternRule* pattern = &data->patterns[i];
+        patterns[i] = (CachedPattern){ pool_add(&pool, pattern->target), (uint32_t)pattern->line_num,
+                                       dep_pos, (uint32_t)pattern->dep_count,
+                                       cmd_pos, (uint32_t)pattern->cmd_count };
+        for (int j = 0; j < pattern->dep_count; j++) {
+            pattern_deps[dep_pos++] = pool_add(&pool, pattern->dependencies[j]);
+        }
+        for (int j = 0; j < pattern->cmd_count; j++) {
+            command_lines[cmd_pos] = (uint32_t)pattern->command_lines[j];
+            command_offsets[cmd_pos++] = pool_add(&pool, pattern->commands[j]);
+        }
+    }
+    CachedInclude* includes = (CachedInclude*)malloc((data->include_count > 0 ? data->include_count : 1)
+                                                     * sizeof(CachedInclude));
+    for (int i = 0; i < data->include_count; i++) {
+        includes[i] = (CachedInclude){ pool_add(&pool, data->includes[i].files),
+                                       (uint32_t)data->includes[i].line_num, data->includes[i].optional };
+    }
+    // 没有依赖图时CSR偏移和入度全部写0，保持文件布局不变
+    int* zeros = with_graph ? NULL : (int*)calloc(n + 1, sizeof(int));
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.version = CACHE_VERSION;
+    header.path_len = (uint32_t)strlen(cache->makefile_path);
+    header.makefile_size = (uint64_t)cache->size;
+    header.mtime_sec = cache->mtime.tv_sec;
+    header.mtime_nsec = cache->mtime.tv_nsec;
+    header.content_hash = hash;
+    header.symbol_count = (uint32_t)n;
+    header.rule_count = (uint32_t)rule_count;
+    header.dep_total = dep_total;
+    header.cmd_total = cmd_total;
+    header.edge_count = with_graph ? (uint32_t)graph->edge_count : 0;
+    header.topo_count = with_graph ? (uint32_t)order_size : 0;
+    header.flags = (with_graph ? CACHE_HAS_GRAPH : 0) | (data->oneshell_all ? CACHE_ONESHELL_ALL : 0);
+    header.pattern_count = (uint32_t)data->pattern_count;
+    header.pattern_dep_total = pattern_dep_total;
+    header.oneshell_count = (uint32_t)data->oneshell_count;
+    header.include_count = (uint32_t)data->include_count;
+    header.strings_size = pool.size;
+    header.symbol_hash = with_graph ? node_table_hash(graph) : 0;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache->cache_path);
+    FILE* file = fopen(tmp_path, "wb");
+    int status = 1;
+    if (file != NULL) {
+        // 先占位写文件头，内容写完后回填校验哈希
+        uint64_t payload_hash = 0xCBF29CE484222325ull;
+        fwrite(&header, sizeof(header), 1, file);
+        cache_write(file, &payload_hash, symbol_offsets, n * sizeof(uint32_t));
+        cache_write(file, &payload_hash, rules, rule_count * sizeof(CachedRule));
+        cache_write(file, &payload_hash, deps, dep_total * sizeof(uint32_t));
+        cache_write(file, &payload_hash, command_offsets, cmd_total * sizeof(uint32_t));
+        cache_write(file, &payload_hash, command_lines, cmd_total * sizeof(uint32_t));
+        if (with_graph) {
+            cache_write(file, &payload_hash, graph->out_offset, (n + 1) * sizeof(int));
+            cache_write(file, &payload_hash, graph->out_edges, graph->edge_count * sizeof(int));
+            cache_write(file, &payload_hash, graph->in_offset, (n + 1) * sizeof(int));
+            cache_write(file, &payload_hash, graph->in_edges, graph->edge_count * sizeof(int));
+            cache_write(file, &payload_hash, graph->in_degree, n * sizeof(int));
+            cache_write(file, &payload_hash, topo_order, order_size * sizeof(int));
+        } else {
+            cache_write(file, &payload_hash, zeros, (n + 1) * sizeof(int));
+            cache_write(file, &payload_hash, zeros, (n + 1) * sizeof(int));
+            cache_write(file, &payload_hash, zeros, n * sizeof(int));
+        }
+        cache_write(file, &payload_hash, patterns, data->pattern_count * sizeof(CachedPattern));
+        cache_write(file, &payload_hash, pattern_deps, pattern_dep_total * sizeof(uint32_t));
+        cache_write(file, &payload_hash, data->oneshell_targets, data->oneshell_count * sizeof(SymbolId));
+        cache_write(file, &payload_hash, includes, data->include_count * sizeof(CachedInclude));
+        cache_write(file, &payload_hash, cache->makefile_path, header.path_len + 1);
+        cache_write(file, &payload_hash, pool.data, pool.size);
+        header.payload_hash = payload_hash;
+        rewind(file);
+        fwrite(&header, sizeof(header), 1, file);
+        int write_failed = ferror(file);
+        if (fclose(file) == 0 && !write_failed && rename(tmp_path, cache->cache_path) == 0) {
+            status = 0;
+        } else {
+            unlink(tmp_path);
+        }
+    }
+    if (status != 0) {
+        perror("警告：无法写入Makefile缓存");
+    }
+    free(symbol_offsets);
+    free(rules);
+    free(deps);
+    free(command_offsets);
+    free(command_lines);
+    free(patterns);
+    free(pattern_deps);
+    free(includes);
+    free(zeros);
+    free(pool.data);
+    return status;
+}
+
+// 解除缓存映射并释放
+void makefile_cache_close(MakefileCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    if (cache->map != NULL) {
+        munmap((void*)cache->map, cache->map_size);
+    }
+    free(cache->makefile_path);
+    free(cache->cache_path);
+    free(cache);
+}
@@ -0,0 +1,37 @@
+#ifndef MAKEFILE_CACHE_H
+#define MAKEFILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAKEFILE_CACHE_FILE ".minimake.cache"  // 编译后Makefile的缓存文件(位于当前目录)
+
+struct DependencyGraph;
+struct MakefileData;
+
+// 编译后Makefile缓存：以Makefile的路径、大小、mtime和内容哈希为键，
+// 保存解析出的符号、规则、展开后的命令、模式规则、CSR依赖图和拓扑顺序
+typedef struct MakefileCache {
+    char* makefile_path;       // Makefile路径(键的一部分)
+    char* cache_path;          // 缓存文件路径
+    long long size;            // Makefile当前大小
+    struct timespec mtime;     // Makefile当前mtime
+    int has_hash;              // content_hash是否已计算
+    uint64_t content_hash;     // Makefile当前内容哈希
+
+    const char* map;           // 映射的缓存文件(键匹配且校验通过时非NULL)
+    size_t map_size;
+    int hit;                   // 缓存键是否与当前Makefile一致
+    int loaded;                // 规则是否已从缓存载入(此时依赖图和拓扑顺序也取自缓存)
+} MakefileCache;
+
+MakefileCache* makefile_cache_open(const char* makefile_path, const char* cache_path);
+int makefile_cache_load(MakefileCache* cache, struct MakefileData* data);
+int makefile_cache_fill_graph(MakefileCache* cache, struct DependencyGraph* graph);
+int* makefile_cache_topo(MakefileCache* cache, struct DependencyGraph* graph, int* order_size);
+int makefile_cache_save(MakefileCache* cache, struct MakefileData* data, struct DependencyGraph* graph,
+                        const int* topo_order, int order_size);
+void makefile_cache_close(MakefileCache* cache);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "makefile_reader.h"
+
+// 打开并映射Makefile，成功返回0
+int reader_open(MakefileReader *reader, const char *filename) {
+    reader->data = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+    reader->line_num = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("无法打开文件");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("无法获取文件状态");
+        close(fd);
+        return 1;
+    }
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("无法映射文件");
+            close(fd);
+            return 1;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        reader->data = (const char *)map;
+        reader->size = st.st_size;
+    }
+    close(fd);  // 映射建立后即可关闭文件描述符
+    return 0;
+}
+
+// 读取下一行(不含换行符)，文件结束返回false
+bool reader_next_line(MakefileReader *reader, StrView *line) {
+    if (reader->pos >= reader->size) {
+        return false;
+    }
+    const char *start = reader->data + reader->pos;
+    size_t remaining = reader->size - reader->pos;
+    const char *newline = memchr(start, '\n', remaining);
+    size_t len = newline ? (size_t)(newline - start) : remaining;
+
+    line->ptr = start;
+    line->len = len;
+    reader->pos += len + (newline ? 1 : 0);
+    reader->line_num++;
+    return true;
+}
+
+// 解除映射
+void reader_close(MakefileReader *reader) {
+    if (reader->data != NULL) {
+        munmap((void *)reader->data, reader->size);
+    }
+    reader->data = NULL;
+    reader->size = 0;
+}
+
+// 去除视图首尾空白
+StrView view_trim(StrView view) {
+    while (view.len > 0 && isspace((unsigned char)*view.ptr)) {
+        view.ptr++;
+        view.len--;
+    }
+    return view_trim_right(view);
+}
+
+// 去除视图尾部空白
+StrView view_trim_right(StrView view) {
+    while (view.len > 0 && isspace((unsigned char)view.ptr[view.len - 1])) {
+        view.len--;
+    }
+    return view;
+}
+
+// 在视图中查找字符，未找到返回NULL
+const char *view_find(StrView view, char ch) {
+    return view.len > 0 ? memchr(view.ptr, ch, view.len) : NULL;
+}
+
+// 把一行拆成变量名、赋值运算符和值(名称和值已去除首尾空白)。
+// 不含'='或'='左边出现':'(如目标行 "a: b=c")时不是赋值，返回false
+bool view_split_assignment(StrView line, StrView *name, AssignOp *op, StrView *value) {
+    const char *equal_pos = view_find(line, '=');
+    if (equal_pos == NULL) {
+        return false;
+    }
+    const char *name_end = equal_pos;
+    *op = ASSIGN_RECURSIVE;
+    if (name_end > line.ptr) {
+        switch (name_end[-1]) {
+        case ':':
+            *op = ASSIGN_SIMPLE;
+            name_end--;
+            if (name_end > line.ptr && name_end[-1] == ':') {
+                name_end--;  // ::=
+            }
+            break;
+        case '?':
+            *op = ASSIGN_CONDITIONAL;
+            name_end--;
+            break;
+        case '+':
+            *op = ASSIGN_APPEND;
+            name_end--;
+            break;
+        }
+    }
+    StrView name_view = { line.ptr, name_end - line.ptr };
+    if (view_find(name_view, ':') != NULL) {
+        return false;
+    }
+    *name = view_trim(name_view);
+    StrView value_view = { equal_pos + 1, line.len - (equal_pos + 1 - line.ptr) };
+    *value = view_trim(value_view);
+    return true;
+}
+
+// 识别include指令("include 文件..."，"-include"和"sinclude"在文件不存在时忽略)，
+// 通过files返回去除首尾空白的文件列表。关键字后必须是空白或行尾
+bool view_split_include(StrView line, StrView *files, bool *optional) {
+    static const char *keywords[] = { "include", "-include", "sinclude" };
+    line = view_trim(line);
+    for (int i = 0; i < 3; i++) {
+        size_t len = strlen(keywords[i]);
+        if (line.len >= len && memcmp(line.ptr, keywords[i], len) == 0
+            && (line.len == len || isspace((unsigned char)line.ptr[len]))) {
+            StrView rest = { line.ptr + len, line.len - len };
+            *files = view_trim(rest);
+            *optional = i > 0;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,39 @@
+#ifndef MAKEFILE_READER_H
+#define MAKEFILE_READER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// 字符串视图：指向映射内存中的一段内容(不以'\0'结尾，不拥有内存)
+typedef struct {
+    const char *ptr;
+    size_t len;
+} StrView;
+
+// 基于mmap的Makefile读取器：整个文件映射到内存，按行返回视图，行长度不受限制
+typedef struct {
+    const char *data;   // 映射的文件内容
+    size_t size;        // 文件大小
+    size_t pos;         // 下一行的起始偏移
+    int line_num;       // 最近一次返回的行号
+} MakefileReader;
+
+// 变量赋值运算符
+typedef enum {
+    ASSIGN_RECURSIVE,   // VAR = value   使用时才展开
+    ASSIGN_SIMPLE,      // VAR := value  定义时展开一次(也接受 ::=)
+    ASSIGN_CONDITIONAL, // VAR ?= value  仅在未定义时赋值
+    ASSIGN_APPEND       // VAR += value  追加到已有值
+} AssignOp;
+
+int reader_open(MakefileReader *reader, const char *filename);
+bool reader_next_line(MakefileReader *reader, StrView *line);
+void reader_close(MakefileReader *reader);
+
+StrView view_trim(StrView view);
+StrView view_trim_right(StrView view);
+const char *view_find(StrView view, char ch);
+bool view_split_assignment(StrView line, StrView *name, AssignOp *op, StrView *value);
+bool view_split_include(StrView line, StrView *files, bool *optional);
+
+#endif
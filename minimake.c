@@ -1,20 +1,19 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "preprocessing.h"
 #include "level2.h"
 #include "level3.h"
 #include "level4.h"
 #include "level5.h"
+#include "jobserver.h"
+#include "trace.h"
+#include "watch.h"
+#include "daemon.h"
 
 
 int main(int argc, char *argv[])
 {
-    // 处理不带任何参数的情况
-    if (argc == 1) {
-        printf("没有提供任何参数。用法: %s [选项]...\n", argv[0]);
-        printf("使用 '%s --help' 查看所有可用选项。\n", argv[0]);
-        return 0;
-    }
     // 遍历所有参数进行处理
     for (int i = 1; i < argc; i++) {
         // 检查是否是帮助命令
@@ -42,6 +41,32 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "-v") == 0) {
             printf("详细输出模式已启用\n");
         }
+        // 处理并行任务数：-j N 或 -jN
+        else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *num = argv[i] + 2;
+            if (*num == '\0') {
+                if (i + 1 >= argc) {
+                    printf("错误: 选项 '-j' 需要一个任务数作为参数\n");
+                    return 1;
+                }
+                num = argv[++i];
+            }
+            if (atoi(num) <= 0) {
+                printf("错误: 无效的任务数 '%s'\n", num);
+                return 1;
+            }
+        }
+        // 监视模式、守护进程和客户端
+        else if (strcmp(argv[i], "--watch") == 0 || strcmp(argv[i], "--daemon") == 0
+                 || strcmp(argv[i], "--client") == 0) {
+        }
+        // 处理跟踪输出：--trace=FILE
+        else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (argv[i][8] == '\0') {
+                printf("错误: 选项 '--trace=' 需要一个文件名\n");
+                return 1;
+            }
+        }
         // 检查未知参数
         
         else if(argv[i][0]== '-'){
@@ -52,48 +77,93 @@ int main(int argc, char *argv[])
         }
     }
     int verbose = 0;
+    int jobs = 0;  // 0表示串行构建
+    const char *trace_path = NULL;
+    int watch = 0;
+    int daemon = 0;
+    int client = 0;
+    // 位置参数是要构建的目标，没有时构建默认目标(第一个规则)
+    const char **goals = (const char **)malloc(argc * sizeof(char *));
+    int goal_count = 0;
 
-    // 解析命令行参数，检查是否为调试模式
+    // 解析命令行参数，检查是否为调试模式、并行任务数及构建目标
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
             verbose = 1;
-            break;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            i++;  // 跳过文件名
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            jobs = atoi(argv[i][2] != '\0' ? argv[i] + 2 : argv[++i]);
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon = 1;
+        } else if (strcmp(argv[i], "--client") == 0) {
+            client = 1;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else if (argv[i][0] != '-') {
+            goals[goal_count++] = argv[i];
         }
     }
-    
-    
-    // 检查命令行参数
-    if (argc ==1) {
-        printf("用法: %s <目标名称>\n", argv[0]);
-        printf("示例: %s app\n", argv[0]);
-        return 1;
+
+    // 客户端模式：交给常驻守护进程构建，不在本进程解析Makefile
+    if (client) {
+        int status = daemon_client(jobs, goals, goal_count);
+        if (status >= 0) {
+            free(goals);
+            return status;
+        }
+        printf("没有运行中的守护进程 (%s)，改为本地构建\n", DAEMON_SOCKET);
     }
     
-    // 处理Makefile
-    process_makefile(verbose);
-    
 //解析Makefile文件--------------------------------------------------------------------------  
+    // 单遍完成注释清理、语法检查和规则构建；调试模式下顺带输出清理后的内容
     char *makefile_path = "./Makefile";
+    FILE *cleaned_out = NULL;
     if(verbose){
-    makefile_path = "./Minimake_cleared.mk";
-    }
-     
-    // 支持通过参数指定其他文件（如预处理后的文件）
-   /* if (argc > 1) {
-        makefile_path = argv[1];
+        cleaned_out = fopen("Minimake_cleared.mk", "w");
+        if (cleaned_out == NULL) {
+            perror("警告：无法创建输出文件Minimake_cleared.mk");
+        }
     }
-*/
-    if(check_makefile_syntax(makefile_path)!=0){ 
-    printf("Makefile语法错误，无法继续执行\n");
-    return 1;
+    
+    // 跟踪从解析开始计时；无法创建文件时只给出警告，照常构建
+    if (trace_path != NULL) {
+        trace_open(trace_path);
     }
+    double parse_start = trace_now();
     
     MakefileData data;
     init_makefile_data(&data);
     
-    int result = parse_and_check_makefile(makefile_path, &data);
+    // Makefile未变时直接载入编译后的缓存；调试模式需要输出清理后的内容，总是完整解析
+    MakefileCache *cache = makefile_cache_open(makefile_path, MAKEFILE_CACHE_FILE);
+    int result;
+    if (!verbose && makefile_cache_load(cache, &data)) {
+        printf("Makefile未改变，使用缓存 %s\n", MAKEFILE_CACHE_FILE);
+        result = 0;
+    } else {
+        result = parse_and_check_makefile(makefile_path, &data, cleaned_out);
+    }
+    data.cache = cache;
+    trace_phase("parse", parse_start);
+    if (cleaned_out != NULL) {
+        fclose(cleaned_out);
+        printf("\n调试模式：清理后的内容已保存到Minimake_cleared.mk\n");
+    }
+    if(result==PARSE_SYNTAX_ERROR){
+    printf("Makefile语法错误，无法继续执行\n");
+    free_makefile_data(&data);
+    free(goals);
+    trace_close();
+    return 1;
+    }
     if(result!=0){
     printf("Makefile解析失败，无法继续执行\n");
+    free_makefile_data(&data);
+    free(goals);
+    trace_close();
     return 1;
     }
     
@@ -102,26 +172,59 @@ int main(int argc, char *argv[])
     printf("\n解析到 %d 个规则:\n", data.rule_count);
     for (int i = 0; i < data.rule_count; i++) {
         Rule *rule = &data.rules[i];
-        printf("目标: %s (行号: %d)\n", rule->target, rule->line_num);
+        printf("目标: %s (行号: %d)\n", symbol_name(&data.symbols, rule->target), rule->line_num);
         printf("  依赖(%d个): ", rule->dep_count);
         for (int j = 0; j < rule->dep_count; j++) {
-            printf("%s ", rule->dependencies[j]);
+            printf("%s ", symbol_name(&data.symbols, rule->dependencies[j]));
         }
         printf("\n  命令(%d个):\n", rule->cmd_count);
         for (int j = 0; j < rule->cmd_count; j++) {
             printf("    %s\n", rule->commands[j]);
         }
     }
+    if (data.pattern_count > 0) {
+        printf("\n解析到 %d 个模式规则:\n", data.pattern_count);
+    }
+    for (int i = 0; i < data.pattern_count; i++) {
+        PatternRule *pattern = &data.patterns[i];
+        printf("模式: %s (行号: %d)\n", pattern->target, pattern->line_num);
+        printf("  依赖(%d个): ", pattern->dep_count);
+        for (int j = 0; j < pattern->dep_count; j++) {
+            printf("%s ", pattern->dependencies[j]);
+        }
+        printf("\n  命令(%d个):\n", pattern->cmd_count);
+        for (int j = 0; j < pattern->cmd_count; j++) {
+            printf("    %s\n", pattern->commands[j]);
+        }
+    }
 //----------------------------------------------------------------------------------------  
     
  
     //execute_target(&data, argv[1]);//第一次编译执行函数
     
     
-    //构建依赖图，拓扑排序，执行时间戳检查和构建判断
-    test(&data);
+    // 加入外层make的jobserver，或在并行构建时创建自己的jobserver供嵌套调用共享。
+    // 守护进程按每个请求的-j各自创建
+    if (!daemon) {
+        jobserver_setup(jobs);
+    }
     
+    //构建依赖图，拓扑排序，执行时间戳检查和构建判断
+    // 监视模式和守护进程模式下保留解析结果和依赖图，文件变化时增量处理
+    int status;
+    if (daemon) {
+        status = daemon_serve(&data, makefile_path);
+    } else if (watch) {
+        status = watch_build(&data, makefile_path, jobs, goals, goal_count);
+    } else {
+        status = test(&data, jobs, goals, goal_count);
+    }
+    jobserver_shutdown();
     
-    return 0;
+    // 规则、命令、变量都在arena中，一次性释放
+    free_makefile_data(&data);
+    free(goals);
+    trace_close();
+    return status;
     }
 
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pattern_rules.h"
+#include "level3.h"
+
+// 模式规则(%.o: %.c)：解析时只记录模式，不展开成普通规则。构建前从构建目标出发沿依赖
+// 遍历，遇到没有规则的文件才查找能生成它的模式规则并实例化，因此只有构建目标需要的规则
+// 才会被创建。查找使用以目标模式原文("前缀%后缀")为键的哈希索引：对文件名按每种出现过的
+// 形状(%前后的长度)截取前后缀拼成键，每种形状一次哈希查找，与模式规则的数量无关
+
+// 哈希索引回调：取模式规则的目标模式原文
+static const char *pattern_key(const void *ctx, int idx) {
+    return ((const MakefileData *)ctx)->patterns[idx].target;
+}
+
+void pattern_rules_init(MakefileData *data) {
+    data->patterns = NULL;
+    data->pattern_count = 0;
+    data->pattern_capacity = 0;
+    hash_index_init(&data->pattern_index, pattern_key, data);
+    data->pattern_shapes = NULL;
+    data->shape_count = 0;
+    data->shape_capacity = 0;
+    data->current_pattern = -1;
+}
+
+// 释放模式索引(模式规则本身随arena释放)
+void pattern_rules_free(MakefileData *data) {
+    hash_index_free(&data->pattern_index);
+    data->patterns = NULL;
+    data->pattern_count = 0;
+    data->pattern_capacity = 0;
+    data->pattern_shapes = NULL;
+    data->shape_count = 0;
+    data->shape_capacity = 0;
+    data->current_pattern = -1;
+}
+
+// 记录目标模式的形状(已有则忽略)，保持按前后缀总长从长到短排列，总长相同时先出现的在前
+static void add_pattern_shape(MakefileData *data, size_t prefix_len, size_t suffix_len) {
+    int pos = data->shape_count;
+    for (int i = 0; i < data->shape_count; i++) {
+        PatternShape *shape = &data->pattern_shapes[i];
+        if (shape->prefix_len == prefix_len && shape->suffix_len == suffix_len) {
+            return;
+        }
+        if (pos == data->shape_count && shape->prefix_len + shape->suffix_len < prefix_len + suffix_len) {
+            pos = i;
+        }
+    }
+    data->pattern_shapes = arena_reserve(&data->arena, data->pattern_shapes, &data->shape_capacity,
+                                         data->shape_count, sizeof(PatternShape));
+    memmove(&data->pattern_shapes[pos + 1], &data->pattern_shapes[pos],
+            (data->shape_count - pos) * sizeof(PatternShape));
+    data->pattern_shapes[pos].prefix_len = prefix_len;
+    data->pattern_shapes[pos].suffix_len = suffix_len;
+    data->shape_count++;
+}
+
+// 新增一条模式规则并登记到索引中(目标模式相同的规则按定义顺序链接)。
+// target必须恰好含一个%；依赖和命令由调用者填写
+PatternRule *add_pattern_rule(MakefileData *data, const char *target, size_t len, int line_num) {
+    data->patterns = arena_reserve(&data->arena, data->patterns, &data->pattern_capacity,
+                                   data->pattern_count, sizeof(PatternRule));
+    int idx = data->pattern_count++;
+    PatternRule *pattern = &data->patterns[idx];
+    pattern->target = arena_strndup(&data->arena, target, len);
+    pattern->prefix_len = (size_t)(strchr(pattern->target, '%') - pattern->target);
+    pattern->suffix_len = len - pattern->prefix_len - 1;
+    pattern->dependencies = NULL;
+    pattern->dep_count = 0;
+    pattern->commands = NULL;
+    pattern->command_lines = NULL;
+    pattern->cmd_count = 0;
+    pattern->cmd_capacity = 0;
+    pattern->line_num = line_num;
+    pattern->next_same_target = -1;
+
+    int first = hash_index_find_n(&data->pattern_index, target, len);
+    if (first == -1) {
+        hash_index_insert(&data->pattern_index, pattern->target, idx);
+        add_pattern_shape(data, pattern->prefix_len, pattern->suffix_len);
+    } else {
+        while (data->patterns[first].next_same_target != -1) {
+            first = data->patterns[first].next_same_target;
+        }
+        data->patterns[first].next_same_target = idx;
+    }
+    return pattern;
+}
+
+// 解析模式规则的目标行(如 "%.o: %.c $(HDRS)")，之后的命令行归属这条模式规则
+void parse_pattern_line(MakefileData *data, StrView target, StrView deps, int line_num) {
+    const char *percent = view_find(target, '%');
+    StrView rest = { percent + 1, target.len - (percent + 1 - target.ptr) };
+    for (size_t i = 0; i < target.len; i++) {
+        if (isspace((unsigned char)target.ptr[i])) {
+            add_error(data, "Line%d: Pattern rule with multiple targets '%.*s'",
+                      line_num, (int)target.len, target.ptr);
+            data->current_pattern = -2;  // 丢弃随后的命令行
+            return;
+        }
+    }
+    if (view_find(rest, '%') != NULL) {
+        add_error(data, "Line%d: Multiple '%%' in pattern target '%.*s'",
+                  line_num, (int)target.len, target.ptr);
+        data->current_pattern = -2;
+        return;
+    }
+
+    PatternRule *pattern = add_pattern_rule(data, target.ptr, target.len, line_num);
+    data->current_pattern = data->pattern_count - 1;
+
+    deps = view_trim(deps);
+    if (view_find(deps, '$') != NULL) {
+        deps.ptr = expand_variable(data, deps.ptr, deps.len, &deps.len, line_num);
+    }
+    const char *end = deps.ptr + deps.len;
+    int dep_total = 0;
+    for (const char *p = deps.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        dep_total++;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+    }
+    if (dep_total > 0) {
+        pattern->dependencies = arena_alloc(&data->arena, dep_total * sizeof(char *));
+    }
+    for (const char *p = deps.ptr; p < end; ) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        const char *dep_start = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        pattern->dependencies[pattern->dep_count++] = arena_strndup(&data->arena, dep_start, p - dep_start);
+    }
+}
+
+// 向当前模式规则添加命令：变量现在展开，自动变量在实例化时才有值
+void add_pattern_command(MakefileData *data, StrView line, int line_num) {
+    if (data->current_pattern < 0) {
+        return;
+    }
+    PatternRule *pattern = &data->patterns[data->current_pattern];
+    int lines_capacity = pattern->cmd_capacity;
+    pattern->commands = arena_reserve(&data->arena, pattern->commands, &pattern->cmd_capacity,
+                                      pattern->cmd_count, sizeof(char *));
+    pattern->command_lines = arena_reserve(&data->arena, pattern->command_lines, &lines_capacity,
+                                           pattern->cmd_count, sizeof(int));
+    pattern->command_lines[pattern->cmd_count] = line_num;
+    if (view_find(line, '$') != NULL) {
+        line.ptr = expand_command(data, line.ptr, line.len, &line.len, line_num);
+    }
+    pattern->commands[pattern->cmd_count] = arena_strndup(&data->arena, line.ptr, line.len);
+    pattern->cmd_count++;
+}
+
+// 把依赖模式中的第一个%换成词干，结果写入buffer(按需扩容)
+static const char *substitute_stem(const char *dep, const char *stem, size_t stem_len,
+                                   char **buffer, size_t *capacity) {
+    const char *percent = strchr(dep, '%');
+    if (percent == NULL) {
+        return dep;
+    }
+    size_t head = percent - dep;
+    size_t tail = strlen(percent + 1);
+    size_t len = head + stem_len + tail;
+    if (len + 1 > *capacity) {
+        *capacity = len + 1;
+        *buffer = (char *)realloc(*buffer, *capacity);
+    }
+    memcpy(*buffer, dep, head);
+    memcpy(*buffer + head, stem, stem_len);
+    memcpy(*buffer + head + stem_len, percent + 1, tail + 1);
+    return *buffer;
+}
+
+// 模式规则查找中的文件状态缓存：与依赖图的stat缓存一样按符号ID索引，建图后交给依赖图继续使用
+typedef struct {
+    StatEntry *entries;
+    int count;
+} SymbolStats;
+
+// 文件是否存在：已驻留的名称每个只stat一次；尚未驻留的名称(只作为候选依赖出现)直接stat
+static bool dep_exists(MakefileData *data, SymbolStats *stats, const char *dep) {
+    int symbol = lookup_symbol(&data->symbols, dep);
+    if (symbol == -1) {
+        return file_exists(dep);
+    }
+    if (symbol >= stats->count) {
+        int count = data->symbols.count;
+        stats->entries = (StatEntry *)realloc(stats->entries, count * sizeof(StatEntry));
+        memset(stats->entries + stats->count, 0, (count - stats->count) * sizeof(StatEntry));
+        stats->count = count;
+    }
+    StatEntry *entry = &stats->entries[symbol];
+    if (!entry->valid) {
+        stat_entry_load(entry, dep);
+    }
+    return entry->exists;
+}
+
+static int match_pattern(MakefileData *data, SymbolStats *stats, const char *name, int depth, bool chain,
+                         size_t *stem_len);
+
+// 依赖能否得到：是已有规则的目标或已存在的文件；chain时也可以由其他模式规则生成
+static bool dep_available(MakefileData *data, SymbolStats *stats, const char *dep, const char *target,
+                          int depth, bool chain) {
+    if (strcmp(dep, target) == 0) {
+        return false;  // 依赖自身的模式(如 %: %)不适用
+    }
+    if (find_target_index(data, dep) != -1 || dep_exists(data, stats, dep)) {
+        return true;
+    }
+    size_t stem_len;
+    return chain && depth + 1 < PATTERN_CHAIN_DEPTH
+           && match_pattern(data, stats, dep, depth + 1, true, &stem_len) != -1;
+}
+
+// 模式规则pattern对词干stem的全部依赖是否都能得到
+static bool pattern_applies(MakefileData *data, SymbolStats *stats, const PatternRule *pattern,
+                            const char *name, size_t stem_len, int depth, bool chain) {
+    const char *stem = name + pattern->prefix_len;
+    char *buffer = NULL;
+    size_t capacity = 0;
+    bool ok = true;
+    for (int i = 0; i < pattern->dep_count && ok; i++) {
+        const char *dep = substitute_stem(pattern->dependencies[i], stem, stem_len, &buffer, &capacity);
+        ok = dep_available(data, stats, dep, name, depth, chain);
+    }
+    free(buffer);
+    return ok;
+}
+
+// 查找能生成name的模式规则：按形状从词干最短到最长依次查索引，同一目标模式的多条规则
+// 按定义顺序尝试。chain为false时依赖必须是已有规则的目标或已存在的文件，为true时依赖也
+// 可以由其他模式规则生成。找到时返回模式规则下标，并通过stem_len返回词干长度，否则返回-1
+static int match_pattern(MakefileData *data, SymbolStats *stats, const char *name, int depth, bool chain,
+                         size_t *stem_len) {
+    size_t len = strlen(name);
+    char small_key[256];
+    char *key = len + 2 <= sizeof(small_key) ? small_key : (char *)malloc(len + 2);
+    int found = -1;
+    for (int s = 0; s < data->shape_count && found == -1; s++) {
+        const PatternShape *shape = &data->pattern_shapes[s];
+        if (shape->prefix_len + shape->suffix_len >= len) {
+            continue;  // %至少匹配一个字符
+        }
+        memcpy(key, name, shape->prefix_len);
+        key[shape->prefix_len] = '%';
+        memcpy(key + shape->prefix_len + 1, name + len - shape->suffix_len, shape->suffix_len);
+        int idx = hash_index_find_n(&data->pattern_index, key, shape->prefix_len + shape->suffix_len + 1);
+        *stem_len = len - shape->prefix_len - shape->suffix_len;
+        for (; idx != -1; idx = data->patterns[idx].next_same_target) {
+            if (pattern_applies(data, stats, &data->patterns[idx], name, *stem_len, depth, chain)) {
+                found = idx;
+                break;
+            }
+        }
+    }
+    if (key != small_key) {
+        free(key);
+    }
+    return found;
+}
+
+// 用模式规则为目标target生成一条普通规则：依赖中的%换成词干，命令中的自动变量按这条规则替换。
+// explicit_idx不为-1时目标已有一条没有命令的显式规则(如 foo.o: foo.h)：与make相同，
+// 新规则的依赖是模式的依赖加上显式规则的依赖($<仍是模式的第一个依赖)，并代替显式规则。
+// 显式规则本身保持不变(Makefile缓存保存的是写出的规则)。返回新规则的下标
+static int instantiate_pattern(MakefileData *data, SymbolId target, int pattern_idx, size_t stem_len,
+                               int explicit_idx) {
+    const PatternRule *pattern = &data->patterns[pattern_idx];
+    const char *name = symbol_name(&data->symbols, target);
+    char *stem = arena_strndup(&data->arena, name + pattern->prefix_len, stem_len);
+    const SymbolId *explicit_deps = NULL;
+    int explicit_count = 0;
+    int line_num = pattern->line_num;
+    if (explicit_idx != -1) {
+        explicit_deps = data->rules[explicit_idx].dependencies;
+        explicit_count = data->rules[explicit_idx].dep_count;
+        line_num = data->rules[explicit_idx].line_num;
+        printf("目标 %s (行号: %d) 没有命令，使用模式规则 %s (行号: %d)\n",
+               name, line_num, pattern->target, pattern->line_num);
+    } else {
+        printf("使用模式规则 %s (行号: %d) 生成目标 %s\n", pattern->target, pattern->line_num, name);
+    }
+
+    int rule_idx = data->rule_count;
+    Rule *rule = add_rule(data, target, line_num);
+    if (pattern->dep_count + explicit_count > 0) {
+        rule->dependencies = arena_alloc(&data->arena, (pattern->dep_count + explicit_count) * sizeof(SymbolId));
+    }
+    char *buffer = NULL;
+    size_t capacity = 0;
+    for (int i = 0; i < pattern->dep_count; i++) {
+        const char *dep = substitute_stem(pattern->dependencies[i], stem, stem_len, &buffer, &capacity);
+        rule->dependencies[rule->dep_count++] = intern_symbol(&data->symbols, dep);
+    }
+    free(buffer);
+    for (int i = 0; i < explicit_count; i++) {
+        bool duplicate = false;
+        for (int j = 0; j < rule->dep_count && !duplicate; j++) {
+            duplicate = rule->dependencies[j] == explicit_deps[i];
+        }
+        if (!duplicate) {
+            rule->dependencies[rule->dep_count++] = explicit_deps[i];
+        }
+    }
+
+    rule->oneshell = oneshell_target(data, target);
+    if (pattern->cmd_count > 0) {
+        rule->commands = arena_alloc(&data->arena, pattern->cmd_count * sizeof(char *));
+        rule->command_lines = pattern->command_lines;  // 行号数组只读，与模式规则共用
+        rule->cmd_capacity = pattern->cmd_count;
+    }
+    for (int i = 0; i < pattern->cmd_count; i++) {
+        size_t cmd_len;
+        const char *command = expand_automatic(data, pattern->commands[i], strlen(pattern->commands[i]),
+                                               rule, stem, &cmd_len);
+        rule->commands[i] = arena_strndup(&data->arena, command, cmd_len);
+        rule->cmd_count++;
+    }
+    return rule_idx;
+}
+
+// 遍历用的符号栈：符号数在遍历中会因实例化而增长，访问标记和栈随之扩容(每个符号最多入栈一次)
+typedef struct {
+    unsigned char *visited;
+    SymbolId *items;
+    int top;
+    int capacity;
+} SymbolStack;
+
+static void push_symbol(SymbolStack *stack, SymbolId symbol) {
+    if ((int)symbol >= stack->capacity) {
+        int old_capacity = stack->capacity;
+        while ((int)symbol >= stack->capacity) {
+            stack->capacity *= 2;
+        }
+        stack->visited = (unsigned char *)realloc(stack->visited, stack->capacity);
+        memset(stack->visited + old_capacity, 0, stack->capacity - old_capacity);
+        stack->items = (SymbolId *)realloc(stack->items, stack->capacity * sizeof(SymbolId));
+    }
+    if (!stack->visited[symbol]) {
+        stack->visited[symbol] = 1;
+        stack->items[stack->top++] = symbol;
+    }
+}
+
+// 从构建目标(为空时取默认目标)出发沿依赖遍历，为没有规则的文件和Makefile中写出的没有命令的
+// 规则(特殊目标除外)实例化模式规则(先只用依赖已存在的模式，都不适用时再允许依赖由其他模式规则生成)。
+// 新实例化的规则的依赖同样被遍历。查找中stat过的文件状态按符号ID记在*stat_cache(共*stat_count项，
+// 调用者释放)中，stat_cache为NULL时用后即弃。返回新实例化的规则数
+int resolve_implicit_rules(MakefileData *data, const char **goals, int goal_count,
+                           StatEntry **stat_cache, int *stat_count) {
+    if (data->pattern_count == 0) {
+        return 0;
+    }
+    SymbolStats stats = { stat_cache != NULL ? *stat_cache : NULL, stat_cache != NULL ? *stat_count : 0 };
+    SymbolStack stack;
+    stack.capacity = data->symbols.count > 0 ? data->symbols.count : 8;
+    stack.visited = (unsigned char *)calloc(stack.capacity, 1);
+    stack.items = (SymbolId *)malloc(stack.capacity * sizeof(SymbolId));
+    stack.top = 0;
+    int instantiated = 0;
+
+    if (goal_count == 0) {
+        int goal = default_goal(data);
+        if (goal != -1) {
+            push_symbol(&stack, (SymbolId)goal);
+        }
+    }
+    for (int i = 0; i < goal_count; i++) {
+        push_symbol(&stack, intern_symbol(&data->symbols, goals[i]));
+    }
+
+    while (stack.top > 0) {
+        SymbolId symbol = stack.items[--stack.top];
+        int rule_idx = find_rule_index(data, symbol);
+        const char *name = symbol_name(&data->symbols, symbol);
+        // 已被补全过的显式规则此时对应实例化出的新规则(下标不小于parsed_rule_count)，不会重复补全
+        bool commandless = rule_idx != -1 && rule_idx < data->parsed_rule_count
+                           && data->rules[rule_idx].cmd_count == 0 && name[0] != '.';
+        if (rule_idx == -1 || commandless) {
+            size_t stem_len;
+            int pattern_idx = match_pattern(data, &stats, name, 0, false, &stem_len);
+            if (pattern_idx == -1) {
+                pattern_idx = match_pattern(data, &stats, name, 0, true, &stem_len);
+            }
+            if (pattern_idx != -1) {
+                rule_idx = instantiate_pattern(data, symbol, pattern_idx, stem_len, rule_idx);
+                instantiated++;
+            } else if (rule_idx == -1) {
+                continue;  // 普通文件(或无法构建，由依赖检查报告)
+            }
+        }
+        Rule *rule = &data->rules[rule_idx];
+        for (int j = 0; j < rule->dep_count; j++) {
+            push_symbol(&stack, rule->dependencies[j]);
+        }
+    }
+
+    free(stack.items);
+    free(stack.visited);
+    if (stat_cache != NULL) {
+        *stat_cache = stats.entries;
+        *stat_count = stats.count;
+    } else {
+        free(stats.entries);
+    }
+    return instantiated;
+}
@@ -0,0 +1,16 @@
+#ifndef PATTERN_RULES_H
+#define PATTERN_RULES_H
+
+#include "level3.h"
+
+#define PATTERN_CHAIN_DEPTH 4  // 依赖本身也要由模式规则生成时(如 %.o <- %.c <- %.y)允许的最大链长
+
+void pattern_rules_init(MakefileData *data);
+void pattern_rules_free(MakefileData *data);
+PatternRule *add_pattern_rule(MakefileData *data, const char *target, size_t len, int line_num);
+void parse_pattern_line(MakefileData *data, StrView target, StrView deps, int line_num);
+void add_pattern_command(MakefileData *data, StrView line, int line_num);
+int resolve_implicit_rules(MakefileData *data, const char **goals, int goal_count,
+                           StatEntry **stat_cache, int *stat_count);
+
+#endif
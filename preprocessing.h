@@ -7,11 +7,12 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include "makefile_reader.h"
 
-#define MAX_LINE_LENGTH 1024  // 最大行长度
 int check_makefile_syntax(const char *filename);
+int check_line_syntax(StrView line, int line_num, bool *rule_defined);
+int clean_makefile_line(StrView *line);
 void trim_trailing_whitespace(char *str);
-void process_makefile(int verbose);
 void show_help(const char *program_name);
 void show_version();
 int is_valid_option(const char *option);
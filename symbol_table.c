@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbol_table.h"
+
+// 哈希索引回调：取符号ID对应的名称
+static const char* symbol_key(const void* ctx, int idx) {
+    return ((const SymbolTable*)ctx)->names[idx];
+}
+
+// 初始化驻留表，名称字符串分配在给定的内存池中
+void symbol_table_init(SymbolTable* table, Arena* arena) {
+    table->arena = arena;
+    table->names = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    hash_index_init(&table->index, symbol_key, table);
+}
+
+// 驻留一个名称：已存在则返回原ID，否则分配新的ID
+SymbolId intern_symbol(SymbolTable* table, const char* name) {
+    return intern_symbol_n(table, name, strlen(name));
+}
+
+// 驻留长度为len的名称片段(可直接指向映射的Makefile内容)，只有新名称才会复制进内存池
+SymbolId intern_symbol_n(SymbolTable* table, const char* name, size_t len) {
+    int id = hash_index_find_n(&table->index, name, len);
+    if (id != -1) {
+        return (SymbolId)id;
+    }
+    table->names = arena_reserve(table->arena, table->names, &table->capacity,
+                                 table->count, sizeof(char*));
+    table->names[table->count] = arena_strndup(table->arena, name, len);
+    hash_index_insert(&table->index, table->names[table->count], table->count);
+    return (SymbolId)table->count++;
+}
+
+// 查找名称对应的符号ID，未驻留过返回-1
+int lookup_symbol(const SymbolTable* table, const char* name) {
+    return hash_index_find(&table->index, name);
+}
+
+// 根据符号ID取名称
+const char* symbol_name(const SymbolTable* table, SymbolId id) {
+    return table->names[id];
+}
+
+// 释放驻留表的索引(名称随内存池一起释放)
+void symbol_table_free(SymbolTable* table) {
+    hash_index_free(&table->index);
+    table->names = NULL;
+    table->count = 0;
+    table->capacity = 0;
+}
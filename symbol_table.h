@@ -0,0 +1,27 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <stdint.h>
+#include "arena.h"
+#include "hash_index.h"
+
+// 符号ID：目标/依赖文件名在驻留表中的稠密编号(从0开始)
+typedef uint32_t SymbolId;
+
+// 字符串驻留表：每个文件名只保存一份，之后的比较都是整数比较
+typedef struct {
+    Arena* arena;       // 名称字符串所在的内存池
+    char** names;       // 符号ID -> 名称
+    int count;          // 符号数量
+    int capacity;       // names数组容量
+    HashIndex index;    // 名称 -> 符号ID
+} SymbolTable;
+
+void symbol_table_init(SymbolTable* table, Arena* arena);
+SymbolId intern_symbol(SymbolTable* table, const char* name);
+SymbolId intern_symbol_n(SymbolTable* table, const char* name, size_t len);
+int lookup_symbol(const SymbolTable* table, const char* name);
+const char* symbol_name(const SymbolTable* table, SymbolId id);
+void symbol_table_free(SymbolTable* table);
+
+#endif
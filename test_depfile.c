@@ -0,0 +1,150 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+#include "level3.h"
+#include "depfile.h"
+
+// depfile回归测试：include只接受*.d，.d的解析(续行、多目标、只收集已有规则的目标)，
+// 二进制日志的复用与损坏恢复，以及必需/可选depfile无法读取时的处理
+
+static const char *main_makefile =
+    "app: main.o\n"
+    "\tcp main.o app\n"
+    "main.o: main.c\n"
+    "\tcat main.c foo.h > main.o\n"
+    "include main.d\n";
+
+static int parse_text(MakefileData *data, const char *text) {
+    write_file("Makefile", text);
+    init_makefile_data(data);
+    return parse_and_check_makefile("Makefile", data, NULL);
+}
+
+static int has_edge(MakefileData *data, const DepfileEdges *edges, const char *target, const char *dep) {
+    for (int i = 0; i < edges->count; i++) {
+        if (strcmp(symbol_name(&data->symbols, edges->edges[i].target), target) == 0
+            && strcmp(symbol_name(&data->symbols, edges->edges[i].dep), dep) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 解析gcc -MMD格式：续行、同一行多个目标；没有规则的目标(other.o)不收集
+static void parses_depfile(void) {
+    test_enter_dir();
+    write_file("main.c", "int main;\n");
+    write_file("foo.h", "h1\n");
+    write_file("main.d",
+        "main.o: main.c foo.h \\\n"
+        "  bar.h\n"
+        "other.o app: baz.h\n");
+    MakefileData data;
+    CHECK(parse_text(&data, main_makefile) == 0);
+    DepfileEdges edges;
+    CHECK(depfile_collect(&data, DEPFILE_LOG_FILE, &edges) == 0);
+    CHECK(edges.file_count == 1 && edges.parsed_count == 1);
+    CHECK(has_edge(&data, &edges, "main.o", "foo.h"));
+    CHECK(has_edge(&data, &edges, "main.o", "bar.h"));
+    CHECK(has_edge(&data, &edges, "app", "baz.h"));
+    CHECK(!has_edge(&data, &edges, "other.o", "baz.h"));
+    depfile_edges_free(&edges);
+    free_makefile_data(&data);
+
+    // 未改变的depfile取自日志，不重新解析
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(depfile_collect(&data, DEPFILE_LOG_FILE, &edges) == 0);
+    CHECK(edges.parsed_count == 0 && !edges.changed);
+    CHECK(has_edge(&data, &edges, "main.o", "bar.h"));
+    depfile_edges_free(&edges);
+    free_makefile_data(&data);
+
+    // 日志损坏时重新解析全部depfile
+    write_file(DEPFILE_LOG_FILE, "garbage");
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(depfile_collect(&data, DEPFILE_LOG_FILE, &edges) == 0);
+    CHECK(edges.parsed_count == 1);
+    CHECK(has_edge(&data, &edges, "main.o", "foo.h"));
+    depfile_edges_free(&edges);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// include的文件不是*.d时报告语法错误
+static void rejects_makefile_includes(void) {
+    test_enter_dir();
+    write_file("common.mk", "CC = gcc\n");
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "all:\n"
+        "\ttrue\n"
+        "include common.mk\n") != 0);
+    CHECK(data.error_count > 0);
+    CHECK(data.include_count == 0);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 不存在的可选depfile忽略；必需的depfile不存在时记录错误，建图失败
+static void missing_depfiles(void) {
+    test_enter_dir();
+    write_file("main.c", "int main;\n");
+    write_file("foo.h", "h1\n");
+    MakefileData data;
+    DepfileEdges edges;
+    CHECK(parse_text(&data,
+        "main.o: main.c\n"
+        "\tcp main.c main.o\n"
+        "-include main.d\n") == 0);
+    CHECK(depfile_collect(&data, DEPFILE_LOG_FILE, &edges) == 0);
+    CHECK(edges.file_count == 0 && edges.count == 0);
+    depfile_edges_free(&edges);
+    free_makefile_data(&data);
+
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(depfile_collect(&data, DEPFILE_LOG_FILE, &edges) != 0);
+    CHECK(data.error_count > 0);
+    depfile_edges_free(&edges);
+    free_makefile_data(&data);
+
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(build_dependency_graph(&data) == NULL);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 端到端：depfile中列出的头文件内容改变后，目标重新构建
+static void header_change_rebuilds(void) {
+    test_enter_dir();
+    write_file("main.c", "int main;\n");
+    write_file("foo.h", "h1\n");
+    write_file("main.d", "main.o: main.c foo.h\n");
+    MakefileData data;
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(test(&data, 0, NULL, 0) == 0);
+    free_makefile_data(&data);
+
+    write_file("foo.h", "header v2\n");
+    CHECK(parse_text(&data, main_makefile) == 0);
+    CHECK(test(&data, 0, NULL, 0) == 0);
+    free_makefile_data(&data);
+
+    FILE *f = fopen("app", "r");
+    char content[64] = "";
+    CHECK(f != NULL);
+    if (f != NULL) {
+        size_t n = fread(content, 1, sizeof(content) - 1, f);
+        content[n] = '\0';
+        fclose(f);
+    }
+    CHECK(strstr(content, "header v2") != NULL);
+    test_leave_dir();
+}
+
+int main(void) {
+    parses_depfile();
+    rejects_makefile_includes();
+    missing_depfiles();
+    header_change_rebuilds();
+    return test_report("test_depfile");
+}
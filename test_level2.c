@@ -0,0 +1,121 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+#include "level3.h"
+
+// 解析器回归测试：规则/命令/变量行的识别、语法错误报告，
+// 以及.ONESHELL的解析(随后的命令行不归属上一条规则)和单shell执行
+
+static int parse_text(MakefileData *data, const char *text) {
+    write_file("Makefile", text);
+    init_makefile_data(data);
+    return parse_and_check_makefile("Makefile", data, NULL);
+}
+
+static Rule *rule_for(MakefileData *data, const char *target) {
+    int idx = find_target_index(data, target);
+    return idx == -1 ? NULL : &data->rules[idx];
+}
+
+// 目标行、依赖、命令(含变量展开)和行号
+static void parses_rules(void) {
+    test_enter_dir();
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "# 注释\n"
+        "CC = gcc\n"
+        "app: main.o util.o # 行尾注释\n"
+        "\t$(CC) -o app main.o util.o\n"
+        "\n"
+        "main.o: main.c\n"
+        "\t$(CC) -c main.c\n"
+        "\techo done: $@\n") == 0);
+    CHECK(data.rule_count == 2);
+    Rule *app = rule_for(&data, "app");
+    CHECK(app != NULL);
+    if (app != NULL) {
+        CHECK(app->line_num == 3 && app->dep_count == 2);
+        CHECK(app->cmd_count == 1 && strcmp(app->commands[0], "gcc -o app main.o util.o") == 0);
+    }
+    Rule *main_o = rule_for(&data, "main.o");
+    CHECK(main_o != NULL && main_o->cmd_count == 2);
+    if (main_o != NULL && main_o->cmd_count == 2) {
+        CHECK(main_o->command_lines[1] == 8);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 重复目标记录带行号的错误，既不是变量、目标也不是命令的行是语法错误
+static void reports_syntax_errors(void) {
+    test_enter_dir();
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "a:\n"
+        "\ttrue\n"
+        "a:\n"
+        "\ttrue\n") == 1);
+    CHECK(data.error_count == 1 && strstr(data.errors[0], "Line3: Duplicate target 'a'") != NULL);
+    free_makefile_data(&data);
+
+    CHECK(parse_text(&data,
+        "a:\n"
+        "\ttrue\n"
+        "not a rule\n") == PARSE_SYNTAX_ERROR);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// .ONESHELL不是规则：随后的命令行被忽略，不追加到上一条规则；列出的目标才使用单shell
+static void oneshell_parsing(void) {
+    test_enter_dir();
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "a:\n"
+        "\techo a\n"
+        ".ONESHELL: b\n"
+        "\techo stray\n"
+        "b:\n"
+        "\techo b\n") == 0);
+    Rule *a = rule_for(&data, "a");
+    Rule *b = rule_for(&data, "b");
+    CHECK(a != NULL && a->cmd_count == 1);
+    CHECK(b != NULL && b->cmd_count == 1);
+    CHECK(a != NULL && !a->oneshell);
+    CHECK(b != NULL && b->oneshell);
+    CHECK(rule_for(&data, ONESHELL_TARGET) == NULL);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 单shell模式下多行命令共享shell变量；否则每行各自一个shell
+static void oneshell_execution(void) {
+    const char *recipe =
+        "out:\n"
+        "\tX=1\n"
+        "\ttest \"$$X\" = 1 && touch out\n";
+    test_enter_dir();
+    MakefileData data;
+    char text[256];
+    snprintf(text, sizeof(text), ".ONESHELL:\n%s", recipe);
+    CHECK(parse_text(&data, text) == 0);
+    CHECK(test(&data, 0, NULL, 0) == 0);
+    CHECK(file_exists("out"));
+    free_makefile_data(&data);
+    test_leave_dir();
+
+    test_enter_dir();
+    CHECK(parse_text(&data, recipe) == 0);
+    CHECK(test(&data, 0, NULL, 0) != 0);
+    CHECK(!file_exists("out"));
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+int main(void) {
+    parses_rules();
+    reports_syntax_errors();
+    oneshell_parsing();
+    oneshell_execution();
+    return test_report("test_level2");
+}
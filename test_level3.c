@@ -0,0 +1,105 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+#include "level3.h"
+
+// 调度器回归测试：串行与并行构建在目标失败时行为一致(失败目标的下游跳过，
+// 无关目标照常构建)，以及目标选择和节点查找的边界情况
+
+// 在当前目录写入Makefile并解析，返回parse_and_check_makefile的结果
+static int parse_text(MakefileData *data, const char *text) {
+    write_file("Makefile", text);
+    init_makefile_data(data);
+    return parse_and_check_makefile("Makefile", data, NULL);
+}
+
+// 一个目标失败：依赖它的c和all不构建，与它无关的b仍然构建
+static void failure_skips_dependents(int jobs) {
+    test_enter_dir();
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "all: a b c\n"
+        "\ttouch all\n"
+        "a:\n"
+        "\tfalse\n"
+        "b:\n"
+        "\ttouch b\n"
+        "c: a\n"
+        "\ttouch c\n") == 0);
+    int status = test(&data, jobs, NULL, 0);
+    CHECK(status != 0);
+    CHECK(file_exists("b"));
+    CHECK(!file_exists("c"));
+    CHECK(!file_exists("all"));
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 依赖链按顺序构建，第二次构建时全部已是最新
+static void chain_builds_in_order(int jobs) {
+    test_enter_dir();
+    MakefileData data;
+    const char *text =
+        "app: lib\n"
+        "\tcat lib > app\n"
+        "lib: src\n"
+        "\tcat src > lib\n";
+    write_file("src", "v1\n");
+    CHECK(parse_text(&data, text) == 0);
+    CHECK(test(&data, jobs, NULL, 0) == 0);
+    CHECK(file_exists("app"));
+    free_makefile_data(&data);
+
+    // 删除中间文件后再次构建：lib和app都要重新生成
+    remove("lib");
+    CHECK(parse_text(&data, text) == 0);
+    CHECK(test(&data, jobs, NULL, 0) == 0);
+    CHECK(file_exists("lib"));
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 命令行目标：没有规则的已有文件可以作为目标，既没有规则也不存在的目标报错
+static void goal_selection(void) {
+    test_enter_dir();
+    MakefileData data;
+    write_file("data.txt", "x\n");
+    CHECK(parse_text(&data,
+        "out: data.txt\n"
+        "\tcp data.txt out\n") == 0);
+
+    int *order;
+    int order_size;
+    const char *existing[] = { "data.txt" };
+    DependencyGraph *graph = prepare_build(&data, existing, 1, &order, &order_size);
+    CHECK(graph != NULL);
+    if (graph != NULL) {
+        CHECK(find_node_index(graph, "out") >= 0);
+        CHECK(find_node_index(graph, "data.txt") >= 0);
+        CHECK(find_node_index(graph, "no-such-node") == -1);
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+
+    CHECK(parse_text(&data,
+        "out: data.txt\n"
+        "\tcp data.txt out\n") == 0);
+    const char *missing[] = { "typo" };
+    graph = prepare_build(&data, missing, 1, &order, &order_size);
+    CHECK(graph == NULL);
+    CHECK(data.error_count > 0);
+    if (graph != NULL) {
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+int main(void) {
+    failure_skips_dependents(0);
+    failure_skips_dependents(4);
+    chain_builds_in_order(0);
+    chain_builds_in_order(4);
+    goal_selection();
+    return test_report("test_level3");
+}
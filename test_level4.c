@@ -0,0 +1,64 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include <fcntl.h>
+#include "level2.h"
+#include "level4.h"
+
+// 命令执行回归测试：直接posix_spawn的简单命令、交给sh的shell语法和内建命令、
+// 找不到程序时经sh报告，以及异步启动/等待返回的状态和资源使用
+
+// 简单命令直接启动；含重定向、引号、&&等shell语法的命令交给sh
+static void runs_simple_and_shell_commands(void) {
+    test_enter_dir();
+    CHECK(my_system("touch direct") == 0);
+    CHECK(file_exists("direct"));
+    CHECK(my_system("echo 'a b' > quoted && test -s quoted") == 0);
+    CHECK(my_system("false") == 1);
+    CHECK(my_system("sh -c 'exit 7'") == 7);
+    test_leave_dir();
+}
+
+// shell内建命令没有对应的可执行文件，必须经sh执行
+static void runs_shell_builtins(void) {
+    CHECK(my_system(": nothing") == 0);
+    CHECK(my_system("true") == 0);
+    CHECK(my_system("cd /") == 0);
+    CHECK(my_system("exit 3") == 3);
+    CHECK(my_system("test -d /") == 0);
+    CHECK(my_system("command -v sh") == 0);
+    CHECK(my_system("export FOO=1") == 0);
+}
+
+// 找不到的程序经sh重试，返回sh的"not found"状态(127)；sh的报错在测试期间丢弃
+static void missing_program_goes_through_shell(void) {
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+    int status = my_system("no_such_program_minimake_test");
+    struct rusage usage;
+    int usage_status = my_system_usage("no_such_program_minimake_test --flag", &usage);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    CHECK(status == 127);
+    CHECK(usage_status == 127);
+}
+
+// 异步启动后等待：返回对应的pid和退出状态
+static void start_and_wait(void) {
+    pid_t pid = my_system_start("sh -c 'exit 5'");
+    CHECK(pid > 0);
+    pid_t done = 0;
+    struct rusage usage;
+    CHECK(my_system_wait(&done, &usage) == 5);
+    CHECK(done == pid);
+}
+
+int main(void) {
+    runs_simple_and_shell_commands();
+    runs_shell_builtins();
+    missing_program_goes_through_shell();
+    start_and_wait();
+    return test_report("test_level4");
+}
@@ -0,0 +1,117 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+
+// 变量回归测试：= := ?= += 的语义，以及递归变量展开缓存只在其(直接或间接)
+// 引用的变量被重新定义时失效
+
+static void define(MakefileData *data, const char *line) {
+    StrView view = { line, strlen(line) };
+    CHECK(parse_variable_definition(data, view, 1));
+}
+
+// 展开文本并与期望结果比较
+static int expands_to(MakefileData *data, const char *text, const char *expected) {
+    size_t len;
+    const char *result = expand_variable(data, text, strlen(text), &len, 1);
+    if (len != strlen(expected) || memcmp(result, expected, len) != 0) {
+        fprintf(stderr, "  展开 \"%s\" 得到 \"%.*s\"，期望 \"%s\"\n", text, (int)len, result, expected);
+        return 0;
+    }
+    return 1;
+}
+
+static Variable *variable(MakefileData *data, const char *name) {
+    for (int i = 0; i < data->var_count; i++) {
+        if (strcmp(data->variables[i].name, name) == 0) {
+            return &data->variables[i];
+        }
+    }
+    return NULL;
+}
+
+// 递归变量在使用时展开，跟随被引用变量(含间接引用)的修改
+static void recursive_follows_changes(void) {
+    MakefileData data;
+    init_makefile_data(&data);
+    define(&data, "B = x");
+    define(&data, "A = $(B)");
+    define(&data, "C = [$(A)]");
+    CHECK(expands_to(&data, "$(C)", "[x]"));
+    define(&data, "B = y");
+    CHECK(expands_to(&data, "$(A)", "y"));
+    CHECK(expands_to(&data, "$(C)", "[y]"));
+    define(&data, "A = ${B}${B}");
+    CHECK(expands_to(&data, "$(C)", "[yy]"));
+    free_makefile_data(&data);
+}
+
+// 修改无关变量不使已缓存的展开结果失效
+static void unrelated_change_keeps_cache(void) {
+    MakefileData data;
+    init_makefile_data(&data);
+    define(&data, "B = x");
+    define(&data, "A = $(B)-$(B)");
+    define(&data, "OTHER = 1");
+    CHECK(expands_to(&data, "$(A)", "x-x"));
+    Variable *a = variable(&data, "A");
+    CHECK(a != NULL && a->expanded != NULL);
+    const char *cached = a != NULL ? a->expanded : NULL;
+
+    define(&data, "OTHER = 2");
+    CHECK(expands_to(&data, "$(A)", "x-x"));
+    a = variable(&data, "A");
+    CHECK(a != NULL && a->expanded == cached);
+
+    define(&data, "B = z");
+    CHECK(expands_to(&data, "$(A)", "z-z"));
+    free_makefile_data(&data);
+}
+
+// := 在定义时展开；?= 只在未定义时赋值；+= 保持原变量的展开方式
+static void assignment_flavors(void) {
+    MakefileData data;
+    init_makefile_data(&data);
+    define(&data, "B = x");
+    define(&data, "S := $(B)");
+    define(&data, "R = $(B)");
+    define(&data, "B = y");
+    CHECK(expands_to(&data, "$(S) $(R)", "x y"));
+
+    define(&data, "S ?= other");
+    define(&data, "N ?= new");
+    CHECK(expands_to(&data, "$(S) $(N)", "x new"));
+
+    define(&data, "R += $(B)");
+    define(&data, "S += $(B)");
+    define(&data, "B = z");
+    CHECK(expands_to(&data, "$(R)|$(S)", "z z|x y"));
+
+    define(&data, "E =");
+    define(&data, "E += a");
+    CHECK(expands_to(&data, "<$(E)>", "<a>"));
+    free_makefile_data(&data);
+}
+
+// $$展开为$，含$$的递归变量每次都重新展开；命令中的自动变量留到实例化时替换
+static void dollars_and_automatic(void) {
+    MakefileData data;
+    init_makefile_data(&data);
+    define(&data, "D = $$HOME");
+    CHECK(expands_to(&data, "$(D)", "$HOME"));
+    CHECK(expands_to(&data, "$(D)", "$HOME"));
+    define(&data, "CC = gcc");
+    const char *command = "$(CC) -c $< -o $@ $$x";
+    size_t len;
+    const char *result = expand_command(&data, command, strlen(command), &len, 1);
+    CHECK(strcmp(result, "gcc -c $< -o $@ $$x") == 0);
+    free_makefile_data(&data);
+}
+
+int main(void) {
+    recursive_follows_changes();
+    unrelated_change_keeps_cache();
+    assignment_flavors();
+    dollars_and_automatic();
+    return test_report("test_level5");
+}
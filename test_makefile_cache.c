@@ -0,0 +1,155 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+#include "level3.h"
+#include "makefile_cache.h"
+
+// Makefile缓存回归测试：Makefile未变时规则和拓扑顺序取自缓存，
+// 缓存的拓扑顺序只在节点数和节点表(名称)都与当前依赖图一致时使用
+
+static const char *chain_text =
+    "app: main.o util.o\n"
+    "\tcat main.o util.o > app\n"
+    "main.o: main.c\n"
+    "\tcp main.c main.o\n"
+    "util.o: util.c\n"
+    "\tcp util.c util.o\n";
+
+// 按minimake.c的方式读取Makefile：缓存命中时载入，否则完整解析。返回是否命中缓存
+static int load_makefile(MakefileData *data) {
+    init_makefile_data(data);
+    MakefileCache *cache = makefile_cache_open("./Makefile", MAKEFILE_CACHE_FILE);
+    int loaded = makefile_cache_load(cache, data);
+    if (!loaded) {
+        CHECK(parse_and_check_makefile("./Makefile", data, NULL) == 0);
+    }
+    data->cache = cache;
+    return loaded;
+}
+
+// 第一次解析后写入缓存，第二次直接载入，缓存的拓扑顺序覆盖全部节点
+static void cached_topo_order(void) {
+    test_enter_dir();
+    write_file("Makefile", chain_text);
+    write_file("main.c", "m\n");
+    write_file("util.c", "u\n");
+
+    MakefileData data;
+    int *order;
+    int order_size;
+    CHECK(!load_makefile(&data));
+    DependencyGraph *graph = prepare_build(&data, NULL, 0, &order, &order_size);
+    CHECK(graph != NULL);
+    if (graph != NULL) {
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+
+    CHECK(load_makefile(&data));
+    graph = prepare_build(&data, NULL, 0, &order, &order_size);
+    CHECK(graph != NULL);
+    if (graph != NULL) {
+        CHECK(order_size == graph->node_count);
+        int cached_size = 0;
+        int *cached = makefile_cache_topo(data.cache, graph, &cached_size);
+        CHECK(cached != NULL);
+        CHECK(cached_size == graph->node_count);
+        free(cached);
+
+        // 节点数与缓存不一致时不使用缓存的顺序
+        DependencyGraph shrunk = *graph;
+        shrunk.node_count--;
+        CHECK(makefile_cache_topo(data.cache, &shrunk, &cached_size) == NULL);
+
+        // 节点数相同但名称不同(另一份Makefile的节点表)时也不使用
+        write_file("Other.mk",
+            "app: main.o extra.o\n"
+            "\tcat main.o extra.o > app\n"
+            "main.o: main.c\n"
+            "\tcp main.c main.o\n"
+            "extra.o: util.c\n"
+            "\tcp util.c extra.o\n");
+        MakefileData other;
+        init_makefile_data(&other);
+        CHECK(parse_and_check_makefile("Other.mk", &other, NULL) == 0);
+        DependencyGraph *other_graph = build_dependency_graph(&other);
+        CHECK(other_graph != NULL);
+        if (other_graph != NULL) {
+            CHECK(other_graph->node_count == graph->node_count);
+            CHECK(makefile_cache_topo(data.cache, other_graph, &cached_size) == NULL);
+            free_graph(other_graph);
+        }
+        free_makefile_data(&other);
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// Makefile内容改变后缓存失效，重新解析
+static void changed_makefile_misses(void) {
+    test_enter_dir();
+    write_file("Makefile", chain_text);
+    write_file("main.c", "m\n");
+    write_file("util.c", "u\n");
+
+    MakefileData data;
+    int *order;
+    int order_size;
+    CHECK(!load_makefile(&data));
+    DependencyGraph *graph = prepare_build(&data, NULL, 0, &order, &order_size);
+    if (graph != NULL) {
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+
+    write_file("Makefile",
+        "app: main.o\n"
+        "\tcp main.o app\n"
+        "main.o: main.c\n"
+        "\tcp main.c main.o\n");
+    CHECK(!load_makefile(&data));
+    CHECK(data.rule_count == 2);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 含模式规则的Makefile只缓存规则，不缓存依赖图和拓扑顺序
+static void pattern_makefile_has_no_graph(void) {
+    test_enter_dir();
+    write_file("Makefile",
+        "app: main.o\n"
+        "\tcp main.o app\n"
+        "%.o: %.c\n"
+        "\tcp $< $@\n");
+    write_file("main.c", "m\n");
+
+    MakefileData data;
+    int *order;
+    int order_size;
+    CHECK(!load_makefile(&data));
+    DependencyGraph *graph = prepare_build(&data, NULL, 0, &order, &order_size);
+    if (graph != NULL) {
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+
+    CHECK(load_makefile(&data));
+    graph = prepare_build(&data, NULL, 0, &order, &order_size);
+    CHECK(graph != NULL);
+    if (graph != NULL) {
+        int cached_size = 0;
+        CHECK(makefile_cache_topo(data.cache, graph, &cached_size) == NULL);
+        CHECK(find_node_index(graph, "main.c") >= 0);
+        release_build(graph, order);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+int main(void) {
+    cached_topo_order();
+    changed_makefile_misses();
+    pattern_makefile_has_no_graph();
+    return test_report("test_makefile_cache");
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE  // nftw、mkdtemp
+#include "test_util.h"
+#include "level2.h"
+#include "level3.h"
+#include "pattern_rules.h"
+
+// 模式规则回归测试：按需实例化、自动变量替换、链式推导、词干最短的模式优先，
+// 以及没有命令的显式规则使用模式规则的命令
+
+static int parse_text(MakefileData *data, const char *text) {
+    write_file("Makefile", text);
+    init_makefile_data(data);
+    return parse_and_check_makefile("Makefile", data, NULL);
+}
+
+static Rule *rule_for(MakefileData *data, const char *target) {
+    int idx = find_target_index(data, target);
+    return idx == -1 ? NULL : &data->rules[idx];
+}
+
+static int has_dep(MakefileData *data, const Rule *rule, const char *dep) {
+    for (int i = 0; i < rule->dep_count; i++) {
+        if (strcmp(symbol_name(&data->symbols, rule->dependencies[i]), dep) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 默认目标的依赖按模式规则实例化，$< $@ 替换为具体文件名；没有源文件的目标不实例化
+static void instantiates_needed_targets(void) {
+    test_enter_dir();
+    write_file("foo.c", "foo\n");
+    write_file("bar.c", "bar\n");
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "app: foo.o bar.o\n"
+        "\tcat foo.o bar.o > app\n"
+        "%.o: %.c\n"
+        "\tcp $< $@\n") == 0);
+    CHECK(resolve_implicit_rules(&data, NULL, 0, NULL, NULL) == 2);
+
+    Rule *foo = rule_for(&data, "foo.o");
+    CHECK(foo != NULL);
+    if (foo != NULL) {
+        CHECK(foo->dep_count == 1 && has_dep(&data, foo, "foo.c"));
+        CHECK(foo->cmd_count == 1 && strcmp(foo->commands[0], "cp foo.c foo.o") == 0);
+    }
+    CHECK(rule_for(&data, "bar.o") != NULL);
+
+    const char *goals[] = { "baz.o" };
+    CHECK(resolve_implicit_rules(&data, goals, 1, NULL, NULL) == 0);
+    CHECK(rule_for(&data, "baz.o") == NULL);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 依赖本身没有文件时继续用模式规则推导(gen.o <- gen.c <- gen.y)
+static void chains_through_intermediate(void) {
+    test_enter_dir();
+    write_file("gen.y", "grammar\n");
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "%.o: %.c\n"
+        "\tcp $< $@\n"
+        "%.c: %.y\n"
+        "\tcp $< $@\n") == 0);
+    const char *goals[] = { "gen.o" };
+    CHECK(resolve_implicit_rules(&data, goals, 1, NULL, NULL) == 2);
+    Rule *c = rule_for(&data, "gen.c");
+    CHECK(c != NULL && has_dep(&data, c, "gen.y"));
+    CHECK(rule_for(&data, "gen.o") != NULL);
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 多个模式都能匹配时使用词干最短(前后缀最长)的模式
+static void shortest_stem_wins(void) {
+    test_enter_dir();
+    write_file("x.c", "x\n");
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "%.o: %.c\n"
+        "\techo generic $@\n"
+        "build/%.o: %.c\n"
+        "\techo specific $*\n") == 0);
+    const char *goals[] = { "build/x.o" };
+    CHECK(resolve_implicit_rules(&data, goals, 1, NULL, NULL) == 1);
+    Rule *rule = rule_for(&data, "build/x.o");
+    CHECK(rule != NULL);
+    if (rule != NULL) {
+        CHECK(has_dep(&data, rule, "x.c"));
+        CHECK(rule->cmd_count == 1 && strcmp(rule->commands[0], "echo specific x") == 0);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+// 没有命令的显式规则(foo.o: foo.h)取得模式规则的命令，依赖为模式依赖加上显式依赖
+static void commandless_rule_uses_pattern(void) {
+    test_enter_dir();
+    write_file("foo.c", "foo\n");
+    write_file("foo.h", "header\n");
+    MakefileData data;
+    CHECK(parse_text(&data,
+        "foo.o: foo.h\n"
+        "%.o: %.c\n"
+        "\tcp $< $@\n") == 0);
+
+    CHECK(resolve_implicit_rules(&data, NULL, 0, NULL, NULL) == 1);
+    Rule *rule = rule_for(&data, "foo.o");
+    CHECK(rule != NULL);
+    if (rule != NULL) {
+        CHECK(rule->dep_count == 2);
+        CHECK(has_dep(&data, rule, "foo.c") && has_dep(&data, rule, "foo.h"));
+        CHECK(rule->cmd_count == 1 && strcmp(rule->commands[0], "cp foo.c foo.o") == 0);
+    }
+    free_makefile_data(&data);
+
+    // 匹配时stat过的已有符号(此处foo.c已在Makefile中出现)按符号ID返回，供建图后直接使用
+    CHECK(parse_text(&data,
+        "app: foo.o foo.c\n"
+        "\tcat foo.o > app\n"
+        "%.o: %.c\n"
+        "\tcp $< $@\n") == 0);
+    StatEntry *stats = NULL;
+    int stat_count = 0;
+    CHECK(resolve_implicit_rules(&data, NULL, 0, &stats, &stat_count) == 1);
+    int source = lookup_symbol(&data.symbols, "foo.c");
+    CHECK(source >= 0 && source < stat_count);
+    if (source >= 0 && source < stat_count) {
+        CHECK(stats[source].valid && stats[source].exists);
+    }
+    free(stats);
+    free_makefile_data(&data);
+
+    // 端到端：构建后foo.o的内容来自foo.c
+    CHECK(parse_text(&data,
+        "foo.o: foo.h\n"
+        "%.o: %.c\n"
+        "\tcp $< $@\n") == 0);
+    CHECK(test(&data, 0, NULL, 0) == 0);
+    FILE *f = fopen("foo.o", "r");
+    char line[16] = "";
+    CHECK(f != NULL);
+    if (f != NULL) {
+        CHECK(fgets(line, sizeof(line), f) != NULL && strcmp(line, "foo\n") == 0);
+        fclose(f);
+    }
+    free_makefile_data(&data);
+    test_leave_dir();
+}
+
+int main(void) {
+    instantiates_needed_targets();
+    chains_through_intermediate();
+    shortest_stem_wins();
+    commandless_rule_uses_pattern();
+    return test_report("test_pattern_rules");
+}
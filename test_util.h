@@ -0,0 +1,76 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+// 回归测试的公共工具：失败计数的检查宏，以及每个用例独立的临时工作目录。
+// 被测模块的进度输出走stdout，检查失败的信息写到stderr(make test时stdout被丢弃)
+// 使用者需在包含任何头文件之前定义_GNU_SOURCE(nftw、mkdtemp)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+static int test_failures = 0;      // 失败的检查数
+static char test_dir[64];          // 当前用例的临时目录
+static char test_origin[4096];     // 进入临时目录前的工作目录
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: 检查失败: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+// 创建临时目录并切换进去，用例中的Makefile、数据库和缓存文件都写在这里
+static inline void test_enter_dir(void) {
+    if (getcwd(test_origin, sizeof(test_origin)) == NULL) {
+        perror("getcwd");
+        exit(2);
+    }
+    strcpy(test_dir, "/tmp/minimake_test.XXXXXX");
+    if (mkdtemp(test_dir) == NULL || chdir(test_dir) != 0) {
+        perror("无法创建临时目录");
+        exit(2);
+    }
+}
+
+static inline int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// 回到原工作目录并删除临时目录
+static inline void test_leave_dir(void) {
+    if (chdir(test_origin) != 0) {
+        perror("chdir");
+        exit(2);
+    }
+    nftw(test_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// 写入(覆盖)一个文件
+static inline void write_file(const char *path, const char *content) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    fputs(content, f);
+    fclose(f);
+}
+
+// 输出结果并返回进程退出码
+static inline int test_report(const char *name) {
+    if (test_failures > 0) {
+        fprintf(stderr, "%s: %d 项检查失败\n", name, test_failures);
+        return 1;
+    }
+    fprintf(stderr, "%s: 全部通过\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+// Chrome/Perfetto trace-event格式(JSON数组)的时间线输出：
+// 阶段和命令都是完整事件(ph:"X")，计数器为ph:"C"，时间单位为微秒
+static FILE* trace_file = NULL;
+static struct timespec trace_start;
+static int trace_events = 0;
+
+// 打开跟踪文件，成功返回0
+int trace_open(const char* path) {
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL) {
+        perror("警告：无法创建跟踪文件");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    trace_events = 0;
+    fputs("[\n", trace_file);
+    return 0;
+}
+
+// 结束JSON数组并关闭文件
+void trace_close(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+    fputs("\n]\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+// 距离跟踪开始的微秒数；未启用跟踪时返回0，不做系统调用
+double trace_now(void) {
+    if (trace_file == NULL) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace_start.tv_sec) * 1e6 + (now.tv_nsec - trace_start.tv_nsec) / 1e3;
+}
+
+// 写出JSON字符串(带引号并转义)
+static void write_json_string(const char* str) {
+    fputc('"', trace_file);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', trace_file);
+            fputc(*p, trace_file);
+        } else if (*p < 0x20) {
+            fprintf(trace_file, "\\u%04x", *p);
+        } else {
+            fputc(*p, trace_file);
+        }
+    }
+    fputc('"', trace_file);
+}
+
+// 写出事件公共部分：名称、类别、类型、时间戳、进程号和线程号
+static void begin_event(const char* name, const char* category, const char* phase, double ts, int tid) {
+    fputs(trace_events++ > 0 ? ",\n" : "", trace_file);
+    fputs("{\"name\":", trace_file);
+    write_json_string(name);
+    fprintf(trace_file, ",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+            category, phase, ts, (int)getpid(), tid);
+}
+
+// 记录一个从start到现在的阶段span
+void trace_phase(const char* name, double start) {
+    if (trace_file == NULL) {
+        return;
+    }
+    double end = trace_now();
+    begin_event(name, "phase", "X", start, TRACE_PHASE_TID);
+    fprintf(trace_file, ",\"dur\":%.3f}", end - start);
+}
+
+static double timeval_ms(const struct timeval* tv) {
+    return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+// 记录一条命令的span：目标名为事件名，参数中带命令、Makefile行号、退出状态和子进程的rusage
+void trace_command(const char* target, const char* command, int line, int tid, double start,
+                   const struct rusage* usage, int status) {
+    if (trace_file == NULL) {
+        return;
+    }
+    double end = trace_now();
+    begin_event(target, "command", "X", start, tid);
+    fprintf(trace_file, ",\"dur\":%.3f,\"args\":{\"command\":", end - start);
+    write_json_string(command);
+    fprintf(trace_file, ",\"line\":%d,\"status\":%d", line, status);
+    if (usage != NULL) {
+        fprintf(trace_file, ",\"user_ms\":%.3f,\"sys_ms\":%.3f,\"max_rss_kb\":%ld",
+                timeval_ms(&usage->ru_utime), timeval_ms(&usage->ru_stime), usage->ru_maxrss);
+    }
+    fputs("}}", trace_file);
+}
+
+// 记录计数器的当前值(同名计数器的多个series在查看器中叠加显示)
+void trace_counter(const char* name, const char* series, long long value) {
+    if (trace_file == NULL) {
+        return;
+    }
+    begin_event(name, "counter", "C", trace_now(), TRACE_PHASE_TID);
+    fputs(",\"args\":{", trace_file);
+    write_json_string(series);
+    fprintf(trace_file, ":%lld}}", value);
+}
@@ -0,0 +1,16 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/resource.h>
+
+#define TRACE_PHASE_TID 0     // 阶段span所在的线程号；命令span使用任务槽号(串行构建为1)
+
+int trace_open(const char* path);
+void trace_close(void);
+double trace_now(void);
+void trace_phase(const char* name, double start);
+void trace_command(const char* target, const char* command, int line, int tid, double start,
+                   const struct rusage* usage, int status);
+void trace_counter(const char* name, const char* series, long long value);
+
+#endif
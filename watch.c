@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "watch.h"
+#include "level3.h"
+
+// --watch模式：首次构建后保留MakefileData和依赖图，用inotify监视叶子源文件和Makefile。
+// 源文件变化时只把该节点及其下游目标交给构建引擎重新检查；Makefile变化时重新解析。
+// inotify监视的是文件所在的目录：编辑器常以"写临时文件再重命名"的方式保存，
+// 直接监视文件的inode在第一次保存后就会失效
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB)
+
+volatile sig_atomic_t watch_stop_requested = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    watch_stop_requested = 1;
+}
+
+// SIGINT/SIGTERM只设置退出标志，由主循环关闭inotify描述符(和套接字)后正常返回，
+// 使--trace文件得以完整写出。poll不受SA_RESTART影响，被信号中断后总是返回EINTR；
+// 其他系统调用(如等待构建命令的wait4)自动重启
+void watch_install_stop_signals(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = handle_stop;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+// 去掉路径开头的"./"，与Makefile中的写法和事件路径保持一致
+const char* watch_normalize_path(const char* path) {
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    return path;
+}
+
+static const char* watcher_dir_key(const void* ctx, int idx) {
+    return ((const Watcher*)ctx)->dirs[idx];
+}
+
+int watcher_open(Watcher* watcher) {
+    memset(watcher, 0, sizeof(Watcher));
+    hash_index_init(&watcher->dir_index, watcher_dir_key, watcher);
+    watcher->fd = inotify_init1(IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        perror("错误: 无法初始化inotify");
+        return 0;
+    }
+    return 1;
+}
+
+void watcher_close(Watcher* watcher) {
+    close(watcher->fd);
+    for (int i = 0; i < watcher->count; i++) {
+        free(watcher->dirs[i]);
+    }
+    free(watcher->dirs);
+    free(watcher->wds);
+    hash_index_free(&watcher->dir_index);
+}
+
+// 监视文件所在的目录(每个目录只注册一次)
+void watch_file(Watcher* watcher, const char* path) {
+    path = watch_normalize_path(path);
+    const char* slash = strrchr(path, '/');
+    char dir[4096];
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == path) {
+        strcpy(dir, "/");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+    }
+    if (hash_index_find(&watcher->dir_index, dir) != -1) {
+        return;
+    }
+    int wd = inotify_add_watch(watcher->fd, dir, WATCH_EVENTS);
+    if (wd < 0) {
+        printf("警告: 无法监视目录 %s: %s\n", dir, strerror(errno));
+        return;
+    }
+    if (watcher->count == watcher->capacity) {
+        watcher->capacity = watcher->capacity > 0 ? watcher->capacity * 2 : 8;
+        watcher->wds = (int*)realloc(watcher->wds, watcher->capacity * sizeof(int));
+        watcher->dirs = (char**)realloc(watcher->dirs, watcher->capacity * sizeof(char*));
+    }
+    watcher->wds[watcher->count] = wd;
+    watcher->dirs[watcher->count] = strdup(dir);
+    hash_index_insert(&watcher->dir_index, watcher->dirs[watcher->count], watcher->count);
+    watcher->count++;
+}
+
+// 监视构建目标所需的全部叶子节点(没有规则的源文件)所在的目录。
+// 依赖图变化(新的depfile依赖、实例化的模式规则)后再次调用，只为新出现的目录注册
+void watch_graph_leaves(Watcher* watcher, MakefileData* data, DependencyGraph* graph) {
+    for (int i = 0; i < graph->node_count; i++) {
+        if (node_needed(graph, i) && find_rule_by_symbol(data, i) == NULL) {
+            watch_file(watcher, node_name(graph, i));
+        }
+    }
+}
+
+// 由事件还原出文件路径(与Makefile中的名称同样的相对写法)，未知目录返回0
+int watcher_event_path(const Watcher* watcher, const struct inotify_event* event, char* out, size_t size) {
+    for (int i = 0; i < watcher->count; i++) {
+        if (watcher->wds[i] != event->wd) {
+            continue;
+        }
+        if (strcmp(watcher->dirs[i], ".") == 0) {
+            snprintf(out, size, "%s", event->name);
+        } else if (strcmp(watcher->dirs[i], "/") == 0) {
+            snprintf(out, size, "/%s", event->name);
+        } else {
+            snprintf(out, size, "%s/%s", watcher->dirs[i], event->name);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// 处理一批inotify事件：变化的叶子节点记入changed，Makefile变化(或事件溢出)时置makefile_changed。
+// 返回新记入的节点数
+static int collect_events(const Watcher* watcher, DependencyGraph* graph, MakefileData* data,
+                          const char* makefile_path, const char* buffer, ssize_t length,
+                          unsigned char* changed, int* makefile_changed) {
+    int count = 0;
+    for (ssize_t offset = 0; offset < length; ) {
+        const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+            *makefile_changed = 1;  // 丢失了事件，无法知道哪些文件变了，按Makefile变化完整重来
+            continue;
+        }
+        char path[4096];
+        if (event->len == 0 || !watcher_event_path(watcher, event, path, sizeof(path))) {
+            continue;
+        }
+        if (strcmp(path, watch_normalize_path(makefile_path)) == 0) {
+            *makefile_changed = 1;
+            continue;
+        }
+        if (graph == NULL) {
+            continue;
+        }
+        // 只关心本次构建需要的叶子节点；目标文件由构建自己写出，忽略
+        int node = find_node_index(graph, path);
+        if (node != -1 && node_needed(graph, node) && find_rule_by_symbol(data, node) == NULL
+            && !changed[node]) {
+            changed[node] = 1;
+            printf("检测到变化: %s\n", path);
+            count++;
+        }
+    }
+    return count;
+}
+
+// 阻塞等待文件变化，收到第一个事件后再等待WATCH_SETTLE_MS毫秒合并后续事件。
+// 返回变化的叶子节点数，出错或收到退出信号时返回-1
+static int wait_for_changes(const Watcher* watcher, DependencyGraph* graph, MakefileData* data,
+                            const char* makefile_path, unsigned char* changed, int* makefile_changed) {
+    char* buffer = (char*)malloc(WATCH_BUFFER_SIZE);
+    int count = 0;
+    int timeout = -1;  // 第一个事件之前一直等待
+    while (!watch_stop_requested) {
+        struct pollfd pfd = { watcher->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("错误: 等待文件变化失败");
+            free(buffer);
+            return -1;
+        }
+        if (ready == 0) {
+            break;  // 事件已平静下来
+        }
+        ssize_t length = read(watcher->fd, buffer, WATCH_BUFFER_SIZE);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("错误: 读取inotify事件失败");
+            free(buffer);
+            return -1;
+        }
+        count += collect_events(watcher, graph, data, makefile_path, buffer, length,
+                                changed, makefile_changed);
+        if (count > 0 || *makefile_changed) {
+            timeout = WATCH_SETTLE_MS;
+        }
+    }
+    free(buffer);
+    return watch_stop_requested ? -1 : count;
+}
+
+// 把变化的叶子节点及其所有下游节点(限于构建目标所需的节点)标记到dirty中，
+// 并使变化节点的stat缓存失效。返回标记的节点数
+static int mark_downstream(DependencyGraph* graph, const unsigned char* goal_needed, unsigned char* dirty) {
+    int* stack = (int*)malloc((graph->node_count > 0 ? graph->node_count : 1) * sizeof(int));
+    int top = 0;
+    int count = 0;
+    for (int i = 0; i < graph->node_count; i++) {
+        if (dirty[i]) {
+            invalidate_stat(graph, i);
+            stack[top++] = i;
+            count++;
+        }
+    }
+    while (top > 0) {
+        int u = stack[--top];
+        for (int e = graph->out_offset[u]; e < graph->out_offset[u + 1]; e++) {
+            int v = graph->out_edges[e];
+            if (goal_needed[v] && !dirty[v]) {
+                dirty[v] = 1;
+                stack[top++] = v;
+                count++;
+            }
+        }
+    }
+    free(stack);
+    return count;
+}
+
+// 重新解析Makefile(与启动时相同，先尝试编译缓存)，成功返回1
+int reload_makefile(MakefileData* data, const char* makefile_path) {
+    free_makefile_data(data);
+    init_makefile_data(data);
+    MakefileCache* cache = makefile_cache_open(makefile_path, MAKEFILE_CACHE_FILE);
+    int result = 0;
+    if (!makefile_cache_load(cache, data)) {
+        result = parse_and_check_makefile(makefile_path, data, NULL);
+    }
+    data->cache = cache;
+    if (result != 0) {
+        printf("Makefile解析失败，等待修改\n");
+        return 0;
+    }
+    return 1;
+}
+
+// 监视模式主循环：构建一次后等待变化并增量重建，直到出错或收到SIGINT/SIGTERM为止。
+// 因信号退出时释放依赖图、关闭inotify描述符并返回0
+int watch_build(MakefileData* data, const char* makefile_path, int jobs,
+                const char** goals, int goal_count) {
+    watch_install_stop_signals();
+    int parsed = 1;  // 启动时的Makefile已由调用者成功解析
+    while (1) {
+        int* topo_order = NULL;
+        int order_size = 0;
+        DependencyGraph* graph = NULL;
+        if (parsed) {
+            graph = prepare_build(data, goals, goal_count, &topo_order, &order_size);
+        }
+
+        Watcher watcher;
+        if (!watcher_open(&watcher)) {
+            if (graph != NULL) {
+                release_build(graph, topo_order);
+            }
+            return 1;
+        }
+        watch_file(&watcher, makefile_path);
+
+        unsigned char* goal_needed = NULL;
+        unsigned char* dirty = NULL;
+        if (graph != NULL) {
+            run_build(data, graph, topo_order, order_size, jobs);
+            refresh_depfile_edges(data, graph, &topo_order, &order_size);
+            watch_graph_leaves(&watcher, data, graph);
+            goal_needed = graph->needed;
+            dirty = (unsigned char*)calloc(graph->node_count > 0 ? graph->node_count : 1, 1);
+        }
+
+        int makefile_changed = 0;
+        while (!makefile_changed) {
+            printf("\n===== 监视模式: 等待文件变化 (Ctrl-C退出) =====\n");
+            fflush(stdout);
+            int changed = wait_for_changes(&watcher, graph, data, makefile_path, dirty, &makefile_changed);
+            if (changed < 0) {
+                watcher_close(&watcher);
+                if (graph != NULL) {
+                    release_build(graph, topo_order);
+                }
+                free(dirty);
+                if (watch_stop_requested) {
+                    printf("\n监视模式退出\n");
+                    return 0;
+                }
+                return 1;
+            }
+            if (makefile_changed || changed == 0) {
+                continue;
+            }
+
+            // 只让变化的节点及其下游参与这一轮构建，其余节点保持上一轮的结论和stat缓存
+            int marked = mark_downstream(graph, goal_needed, dirty);
+            printf("重新检查 %d 个节点\n", marked);
+            graph->needed = dirty;
+            data->error_count = 0;
+            run_build(data, graph, topo_order, order_size, jobs);
+            graph->needed = goal_needed;
+            // 重新编译的源文件可能包含了新的头文件：按变化的depfile更新依赖边和监视的目录
+            if (refresh_depfile_edges(data, graph, &topo_order, &order_size)) {
+                goal_needed = graph->needed;
+                free(dirty);
+                dirty = (unsigned char*)calloc(graph->node_count > 0 ? graph->node_count : 1, 1);
+            } else {
+                memset(dirty, 0, graph->node_count);
+            }
+            watch_graph_leaves(&watcher, data, graph);
+        }
+
+        printf("\nMakefile已改变，重新解析\n");
+        watcher_close(&watcher);
+        if (graph != NULL) {
+            release_build(graph, topo_order);
+        }
+        free(dirty);
+        parsed = reload_makefile(data, makefile_path);
+    }
+}
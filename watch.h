@@ -0,0 +1,38 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <signal.h>
+#include "level2.h"
+#include "hash_index.h"
+
+#define WATCH_SETTLE_MS 20    // 收到第一个事件后继续收集事件的时间(合并编辑器一次保存产生的多个事件)
+#define WATCH_BUFFER_SIZE 65536
+
+struct inotify_event;
+
+// 按目录注册的inotify监视集合(监视模式和守护进程共用)
+typedef struct {
+    int fd;             // inotify描述符
+    int* wds;           // 各目录的watch描述符
+    char** dirs;        // 被监视的目录("."表示当前目录)
+    int count;
+    int capacity;
+    HashIndex dir_index; // 目录 -> 下标(每个目录只注册一次)
+} Watcher;
+
+struct DependencyGraph;
+
+extern volatile sig_atomic_t watch_stop_requested;  // 收到SIGINT/SIGTERM后置1
+
+void watch_install_stop_signals(void);
+const char* watch_normalize_path(const char* path);
+int watcher_open(Watcher* watcher);
+void watcher_close(Watcher* watcher);
+void watch_file(Watcher* watcher, const char* path);
+void watch_graph_leaves(Watcher* watcher, MakefileData* data, struct DependencyGraph* graph);
+int watcher_event_path(const Watcher* watcher, const struct inotify_event* event, char* out, size_t size);
+int reload_makefile(MakefileData* data, const char* makefile_path);
+int watch_build(MakefileData* data, const char* makefile_path, int jobs,
+                const char** goals, int goal_count);
+
+#endif